@@ -0,0 +1,103 @@
+//
+// Atom_Table contention benchmark
+// Every thread interns the same identifier pool in a different order, the way lexer workers see the
+// same names across files, plus a share of identifiers only it produces. Reports throughput and
+// scaling against one thread, and checks that every thread got the same canonical atoms.
+//
+
+#include "foundation/basic.h"
+#include "foundation/array.h"
+#include "foundation/atom.h"
+#include "foundation/os_helper.h"
+
+#define NUM_SHARED 200000
+#define NUM_UNIQUE 20000
+#define ROUNDS 4
+
+typedef struct Bench_Thread {
+    Atom_Table *atoms;
+    char (*names)[16];
+    uint32_t index;
+    Atom **results;
+    uint64_t ops;
+} Bench_Thread;
+
+static void bench_thread(void *user_data)
+{
+    Bench_Thread *t = user_data;
+    char buf[32];
+    uint32_t step = 7919;
+    for (uint32_t round = 0; round < ROUNDS; ++round) {
+        uint32_t i = (t->index * 104729u + round * 31u) % NUM_SHARED;
+        for (uint32_t n = 0; n < NUM_SHARED; ++n) {
+            const char *name = t->names[i];
+            Atom *atom = atom_add(t->atoms, name, (uint32_t)strlen(name));
+            if (round == 0)
+                t->results[i] = atom;
+            i = (i + step) % NUM_SHARED;
+        }
+        for (uint32_t n = 0; n < NUM_UNIQUE; ++n) {
+            int len = snprintf(buf, sizeof(buf), "t%u_r%u_%u", t->index, round, n);
+            atom_add(t->atoms, buf, (uint32_t)len);
+        }
+        t->ops += NUM_SHARED + NUM_UNIQUE;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_threads = argc > 1 ? (uint32_t)atoi(argv[1]) : 32;
+
+    char (*names)[16] = malloc(sizeof(*names) * NUM_SHARED);
+    uint64_t x = 88172645463325252ULL;
+    for (uint32_t i = 0; i < NUM_SHARED; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        snprintf(names[i], sizeof(names[i]), "id_%x", (uint32_t)(x % 0x7fffffff));
+    }
+
+    printf("{\"cores\":%u,\"results\":[\n", os_num_cores());
+    double base_rate = 0.0;
+    for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        Atom_Table *atoms = atom_table_create(MB(64));
+        Bench_Thread *threads = calloc(num_threads, sizeof(*threads));
+        uint64_t *handles = calloc(num_threads, sizeof(*handles));
+
+        uint64_t start = os_time_now();
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            threads[i] = (Bench_Thread) { 
+                .atoms = atoms, 
+                .names = names, 
+                .index = i, 
+                .results = malloc(sizeof(Atom *) * NUM_SHARED),
+            };
+            handles[i] = os_thread_create(bench_thread, &threads[i]);
+        }
+        uint64_t ops = 0;
+        for (uint32_t i = 0; i < num_threads; ++i) {
+            os_thread_join(handles[i]);
+            ops += threads[i].ops;
+        }
+        double delta = os_time_delta(os_time_now(), start);
+
+        bool canonical = true;
+        for (uint32_t i = 1; i < num_threads; ++i)
+            canonical &= memcmp(threads[i].results, threads[0].results, sizeof(Atom *) * NUM_SHARED) == 0;
+
+        double rate = ops / delta;
+        if (num_threads == 1)
+            base_rate = rate;
+        printf("  {\"threads\":%u,\"ops\":%zu,\"seconds\":%.4f,\"mops_per_s\":%.2f,\"speedup\":%.2f,\"canonical\":%s}%s\n",
+            num_threads, ops, delta, rate / 1e6, rate / base_rate, canonical ? "true" : "false",
+            num_threads * 2 <= max_threads ? "," : "");
+
+        for (uint32_t i = 0; i < num_threads; ++i)
+            free(threads[i].results);
+        free(handles);
+        free(threads);
+        atom_table_destroy(atoms);
+    }
+    printf("]}\n");
+
+    free(names);
+    return 0;
+}
@@ -0,0 +1,489 @@
+//
+// Lexer throughput benchmark
+// Generates deterministic synthetic corpora that each stress one part of the lexer, plus a mix that
+// looks like ordinary source code, writes each to a file and lexes it a number of times. Reports
+// MB/s, tokens/s and cycles/byte of the fastest run, and peak memory, as JSON so results of two
+// versions can be diffed.
+//
+// Usage: bench [--sizes 1,16,64] [--runs 5] [--corpus name] [--compact|--spans|--packed|--buffer] [--vm] [--file path]
+// Sizes are in MB, up to 1024. --compact lexes into a Token_Stream instead of a Token array, --spans
+// lexes into span tokens of a Source_File without interning. --packed lexes into a Token_Pack and
+// also reports its bytes per token and the fastest pass decoding all of it. --buffer reads the file
+// into memory up front and lexes it as pieces of about 64KB through one Lexer_Context.
+// --vm puts the tokens in the fixed virtual memory allocator, so they grow without being copied.
+// peak_alloc_bytes counts what the lexer allocated for one corpus, peak_rss_bytes is the high water
+// mark of the whole process so far, so it only grows from one result to the next.
+//
+
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/array.h"
+#include "foundation/atom.h"
+#include "foundation/cycles.h"
+#include "foundation/os_helper.h"
+#include "lexer.h"
+#include "source_file.h"
+#include "token_pack.h"
+#include "token_stream.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+//
+// Corpus generation
+//
+
+typedef struct Bench_Writer {
+    char *data;
+    uint64_t size;
+    uint64_t capacity;
+    bool full;
+    uint64_t rng;
+} Bench_Writer;
+
+static uint64_t bench_rand(Bench_Writer *w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+static uint32_t bench_below(Bench_Writer *w, uint32_t n)
+{
+    return (uint32_t)(bench_rand(w) % n);
+}
+
+static void bench_put(Bench_Writer *w, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    uint64_t room = w->capacity - w->size;
+    int len = vsnprintf(w->data + w->size, room, fmt, args);
+    va_end(args);
+    if (len >= 0 && (uint64_t)len < room)
+        w->size += len;
+    else
+        w->full = true;
+}
+
+static const char *bench_words[] = {
+    "count", "index", "buffer", "node", "value", "result", "parent", "child", "offset", "length",
+    "table", "entry", "state", "flags", "cursor", "token", "scope", "symbol", "first", "last",
+    "width", "height", "data", "size", "next", "prev", "left", "right", "key", "item",
+};
+#define BENCH_NUM_WORDS (sizeof(bench_words) / sizeof(bench_words[0]))
+
+static const char *bench_word(Bench_Writer *w)
+{
+    return bench_words[bench_below(w, BENCH_NUM_WORDS)];
+}
+
+static void bench_identifier(Bench_Writer *w)
+{
+    switch (bench_below(w, 4)) {
+    case 0: bench_put(w, "%s", bench_word(w)); break;
+    case 1: bench_put(w, "%s_%s", bench_word(w), bench_word(w)); break;
+    case 2: bench_put(w, "%s%u", bench_word(w), bench_below(w, 100)); break;
+    default: bench_put(w, "%c%s", 'a' + bench_below(w, 26), bench_word(w)); break;
+    }
+}
+
+static void bench_number(Bench_Writer *w)
+{
+    switch (bench_below(w, 5)) {
+    case 0: bench_put(w, "%u", bench_below(w, 1000)); break;
+    case 1: bench_put(w, "%llu", (unsigned long long)(bench_rand(w) >> bench_below(w, 60))); break;
+    case 2: bench_put(w, "%u.%u", bench_below(w, 100000), bench_below(w, 1000000)); break;
+    case 3: bench_put(w, "0x%llx", (unsigned long long)(bench_rand(w) >> bench_below(w, 60))); break;
+    default: {
+        bench_put(w, "0b");
+        for (uint32_t i = 0, n = 1 + bench_below(w, 16); i < n; ++i)
+            bench_put(w, "%u", bench_below(w, 2));
+    } break;
+    }
+}
+
+static void bench_string(Bench_Writer *w)
+{
+    bench_put(w, "\"");
+    for (uint32_t i = 0, n = 1 + bench_below(w, 8); i < n; ++i) {
+        bench_put(w, "%s%s", i ? " " : "", bench_word(w));
+        if (bench_below(w, 8) == 0)
+            bench_put(w, bench_below(w, 2) ? "\\n" : "\\\"");
+    }
+    bench_put(w, "\"");
+}
+
+static const char *bench_operators[] = {
+    "+", "-", "*", "/", "=", "+=", "-=", "*=", "/=", "==", "!=", "<", ">", "<=", ">=", "<<", ">>",
+    "&&", "||", "&", "|", "^", "->", "%",
+};
+#define BENCH_NUM_OPERATORS (sizeof(bench_operators) / sizeof(bench_operators[0]))
+
+static void bench_line_identifiers(Bench_Writer *w)
+{
+    bench_put(w, "    ");
+    bench_identifier(w);
+    bench_put(w, " = ");
+    bench_identifier(w);
+    bench_put(w, "(");
+    for (uint32_t i = 0, n = bench_below(w, 4); i < n; ++i) {
+        bench_put(w, i ? ", " : "");
+        bench_identifier(w);
+    }
+    bench_put(w, ");\n");
+}
+
+static void bench_line_comment(Bench_Writer *w)
+{
+    bool block = bench_below(w, 4) == 0;
+    bench_put(w, block ? "    /*" : "    //");
+    for (uint32_t i = 0, n = 4 + bench_below(w, 10); i < n; ++i)
+        bench_put(w, " %s", bench_word(w));
+    bench_put(w, block ? " */\n" : "\n");
+}
+
+static void bench_line_strings(Bench_Writer *w)
+{
+    bench_put(w, "    ");
+    for (uint32_t i = 0, n = 1 + bench_below(w, 3); i < n; ++i) {
+        bench_put(w, i ? ", " : "");
+        bench_string(w);
+    }
+    bench_put(w, ",\n");
+}
+
+static void bench_line_numbers(Bench_Writer *w)
+{
+    bench_put(w, "    ");
+    for (uint32_t i = 0, n = 4 + bench_below(w, 6); i < n; ++i) {
+        bench_put(w, i ? ", " : "");
+        bench_number(w);
+    }
+    bench_put(w, ",\n");
+}
+
+static void bench_line_operators(Bench_Writer *w)
+{
+    bench_put(w, "    %c", 'a' + bench_below(w, 26));
+    for (uint32_t i = 0, n = 4 + bench_below(w, 8); i < n; ++i)
+        bench_put(w, " %s %c", bench_operators[bench_below(w, BENCH_NUM_OPERATORS)], 'a' + bench_below(w, 26));
+    bench_put(w, ";\n");
+}
+
+static void bench_line_mix(Bench_Writer *w)
+{
+    uint32_t r = bench_below(w, 100);
+    if (r < 40) {
+        bench_line_identifiers(w);
+    } else if (r < 55) {
+        bench_line_comment(w);
+    } else if (r < 65) {
+        bench_put(w, "    if (");
+        bench_identifier(w);
+        bench_put(w, " %s ", bench_operators[bench_below(w, BENCH_NUM_OPERATORS)]);
+        bench_number(w);
+        bench_put(w, ") {\n");
+    } else if (r < 75) {
+        bench_put(w, "    }\n");
+    } else if (r < 85) {
+        bench_line_operators(w);
+    } else if (r < 93) {
+        bench_put(w, "    print(");
+        bench_string(w);
+        bench_put(w, ");\n");
+    } else if (r < 97) {
+        bench_put(w, "    return ");
+        bench_number(w);
+        bench_put(w, ";\n");
+    } else {
+        bench_put(w, "\n");
+    }
+}
+
+typedef void Bench_Line_Proc(Bench_Writer *w);
+
+typedef struct Bench_Corpus {
+    const char *name;
+    Bench_Line_Proc *line;
+} Bench_Corpus;
+
+static const Bench_Corpus bench_corpora[] = {
+    { "identifiers", bench_line_identifiers },
+    { "comments", bench_line_comment },
+    { "strings", bench_line_strings },
+    { "numbers", bench_line_numbers },
+    { "operators", bench_line_operators },
+    { "mix", bench_line_mix },
+};
+#define BENCH_NUM_CORPORA (sizeof(bench_corpora) / sizeof(bench_corpora[0]))
+
+// Fill `data` with at most `size` bytes of complete lines, returns the number of bytes written
+static uint64_t bench_generate(const Bench_Corpus *corpus, char *data, uint64_t size, uint64_t seed)
+{
+    Bench_Writer w = { .data = data, .capacity = size, .rng = seed | 1 };
+    for (;;) {
+        uint64_t line_start = w.size;
+        corpus->line(&w);
+        // The line that didn't fit is dropped, the corpus ends on the last complete one
+        if (w.full)
+            return line_start;
+    }
+}
+
+//
+// Allocator that keeps track of the peak number of bytes the lexer has allocated
+//
+
+typedef struct Bench_Memory {
+    // Where the allocations actually go
+    Allocator *parent;
+    uint64_t current;
+    uint64_t peak;
+} Bench_Memory;
+
+static void *bench_alloc(Allocator *a, void *p, uint64_t old_size, uint64_t new_size, const char *file, uint32_t line)
+{
+    Bench_Memory *memory = a->user_data;
+    memory->current += new_size - old_size;
+    if (memory->current > memory->peak)
+        memory->peak = memory->current;
+    return memory->parent->alloc_cb(memory->parent, p, old_size, new_size, file, line);
+}
+
+//
+// Runs
+//
+
+typedef struct Bench_Result {
+    uint64_t tokens;
+    double best_seconds;
+    double total_seconds;
+    uint64_t best_cycles;
+    uint64_t peak_alloc;
+    // Only for BENCH_MODE_PACKED
+    uint64_t packed_bytes;
+    double best_decode_seconds;
+} Bench_Result;
+
+typedef enum Bench_Mode {
+    BENCH_MODE_TOKENS,
+    BENCH_MODE_COMPACT,
+    BENCH_MODE_SPANS,
+    BENCH_MODE_PACKED,
+    BENCH_MODE_BUFFER,
+} Bench_Mode;
+
+static const char *bench_mode_names[] = { "tokens", "compact", "spans", "packed", "buffer" };
+
+// Pieces BENCH_MODE_BUFFER hands to `lexer_lex_buffer`, cut at the last line break before this size
+#define BENCH_BUFFER_SIZE KB(64)
+
+// Lex `data` in pieces through `ctx`, returns the number of tokens of all of them
+static uint64_t bench_lex_buffers(Lexer_Context *ctx, const char *data, uint64_t size)
+{
+    uint64_t num_tokens = 0;
+    for (uint64_t at = 0; at < size;) {
+        uint64_t end = at + BENCH_BUFFER_SIZE < size ? at + BENCH_BUFFER_SIZE : size;
+        uint64_t cut = end;
+        while (cut > at && cut < size && data[cut - 1] != '\n')
+            --cut;
+        if (cut > at)
+            end = cut;
+        num_tokens += lexer_lex_buffer(ctx, data + at, end - at);
+        at = end;
+    }
+    return num_tokens;
+}
+
+static Bench_Result bench_run(const char *path, uint32_t runs, Bench_Mode mode, Allocator *parent)
+{
+    Bench_Result result = { .best_seconds = 1e30, .best_decode_seconds = 1e30 };
+    for (uint32_t run = 0; run < runs; ++run) {
+        Bench_Memory memory = { .parent = parent };
+        Allocator allocator = { .alloc_cb = bench_alloc, .user_data = &memory };
+        Atom_Table *atoms = atom_table_create(MB(16));
+        Token *tokens = 0;
+        Token_Stream stream = { 0 };
+        Token_Pack pack = { 0 };
+        Source_File source = { 0 };
+        Lexer_Context context;
+        lexer_context_init(&context, atoms, &allocator);
+        uint64_t buffer_size = 0;
+        char *buffer = mode == BENCH_MODE_BUFFER ? os_read_entire_file(path, &buffer_size, system_allocator) : 0;
+        uint64_t buffer_tokens = 0;
+
+        uint64_t start_cycles = cycles_now();
+        uint64_t start = os_time_now();
+        if (mode == BENCH_MODE_COMPACT) {
+            lexer_read_file_compact(path, &stream, 0, atoms, &allocator);
+        } else if (mode == BENCH_MODE_PACKED) {
+            lexer_read_file_packed(path, &pack, 0, atoms, &allocator);
+        } else if (mode == BENCH_MODE_BUFFER) {
+            // Reading the file isn't timed, the text is in memory already when it arrives some other way
+            buffer_tokens = bench_lex_buffers(&context, buffer, buffer_size);
+        } else if (mode == BENCH_MODE_SPANS) {
+            // Mapping the file is timed, as it is for the other modes
+            if (source_file_open(&source, path))
+                lexer_read_source(&source, &tokens, &allocator);
+        } else {
+            lexer_read_file(path, &tokens, atoms, &allocator);
+        }
+        double seconds = os_time_delta(os_time_now(), start);
+        uint64_t cycles = cycles_now() - start_cycles;
+
+        if (mode == BENCH_MODE_PACKED) {
+            uint64_t decode_start = os_time_now();
+            uint64_t check = 0;
+            for (Token_Pack_Iterator it = token_pack_iterator(&pack, 0); token_pack_iterator_valid(&it); 
+                token_pack_iterator_next(&it)) {
+                check += it.type + it.offset + it.length + it.payload.int_value;
+            }
+            double decode_seconds = os_time_delta(os_time_now(), decode_start);
+            // Keeps the loop from being optimized away
+            if (check == 1)
+                printf(" ");
+            if (decode_seconds < result.best_decode_seconds)
+                result.best_decode_seconds = decode_seconds;
+            result.packed_bytes = token_pack_bytes(&pack);
+        }
+
+        result.tokens = mode == BENCH_MODE_COMPACT ? token_stream_size(&stream) 
+            : mode == BENCH_MODE_PACKED ? token_pack_size(&pack) 
+            : mode == BENCH_MODE_BUFFER ? buffer_tokens : array_size(tokens);
+        result.total_seconds += seconds;
+        if (seconds < result.best_seconds) {
+            result.best_seconds = seconds;
+            result.best_cycles = cycles;
+        }
+        if (memory.peak > result.peak_alloc)
+            result.peak_alloc = memory.peak;
+
+        token_stream_free(&stream, &allocator);
+        token_pack_free(&pack, &allocator);
+        lexer_context_free(&context);
+        if (buffer)
+            c_free(system_allocator, buffer, buffer_size);
+        array_free(tokens, &allocator);
+        source_file_close(&source);
+        atom_table_destroy(atoms);
+    }
+    return result;
+}
+
+#define BENCH_MAX_SIZE_MB 1024
+
+// Comma separated corpus sizes in MB, each 1-BENCH_MAX_SIZE_MB
+static bool bench_parse_sizes(const char *list, uint64_t **sizes)
+{
+    for (const char *s = list; *s;) {
+        char *end;
+        uint64_t size = strtoull(s, &end, 10);
+        if (end == s || size == 0 || size > BENCH_MAX_SIZE_MB || (*end && *end != ',')) {
+            printf("Invalid --sizes '%s', expected sizes of 1-%u MB separated by commas\n", list, BENCH_MAX_SIZE_MB);
+            return false;
+        }
+        array_push(*sizes, size, system_allocator);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+static bool bench_write_file(const char *path, const char *data, uint64_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(data, 1, size, f) == size;
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t *sizes = 0;
+    uint32_t runs = 5;
+    const char *only = 0;
+    const char *path = "bench_corpus.tmp";
+    Bench_Mode mode = BENCH_MODE_TOKENS;
+    bool vm = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            if (!bench_parse_sizes(argv[++i], &sizes))
+                return 1;
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            mode = BENCH_MODE_COMPACT;
+        } else if (strcmp(argv[i], "--spans") == 0) {
+            mode = BENCH_MODE_SPANS;
+        } else if (strcmp(argv[i], "--packed") == 0) {
+            mode = BENCH_MODE_PACKED;
+        } else if (strcmp(argv[i], "--buffer") == 0) {
+            mode = BENCH_MODE_BUFFER;
+        } else if (strcmp(argv[i], "--vm") == 0) {
+            vm = true;
+        }
+    }
+    if (!sizes) {
+        array_push(sizes, 1, system_allocator);
+        array_push(sizes, 16, system_allocator);
+        array_push(sizes, 64, system_allocator);
+    }
+    if (runs == 0)
+        runs = 1;
+
+    uint64_t max_size = 0;
+    for (uint64_t i = 0; i < array_size(sizes); ++i)
+        max_size = sizes[i] > max_size ? sizes[i] : max_size;
+    // One extra byte for the terminator vsnprintf writes
+    char *data = malloc(MB(max_size) + 1);
+
+    Allocator vm_allocator = allocator_create_fixed_vm(GB(64));
+    Allocator *parent = vm ? &vm_allocator : system_allocator;
+
+    printf("{\"mode\":\"%s\",\"allocator\":\"%s\",\"runs\":%u,\"token_bytes\":%zu,\"results\":[\n",
+        bench_mode_names[mode], vm ? "fixed_vm" : "system", runs, sizeof(Token));
+    bool first = true;
+    for (uint32_t c = 0; c < BENCH_NUM_CORPORA; ++c) {
+        const Bench_Corpus *corpus = &bench_corpora[c];
+        if (only && strcmp(only, corpus->name) != 0)
+            continue;
+
+        for (uint64_t i = 0; i < array_size(sizes); ++i) {
+            uint64_t size = bench_generate(corpus, data, MB(sizes[i]) + 1, 0x9E3779B97F4A7C15ULL + c);
+            if (!bench_write_file(path, data, size)) {
+                printf("Unable to write corpus file: '%s'\n", path);
+                return 1;
+            }
+
+            Bench_Result r = bench_run(path, runs, mode, parent);
+            double mb = size / 1e6;
+            printf("%s  {\"corpus\":\"%s\",\"bytes\":%zu,\"tokens\":%zu,\"seconds\":%.6f,\"mean_seconds\":%.6f,"
+                "\"mb_per_s\":%.2f,\"tokens_per_s\":%.0f,\"cycles_per_byte\":%.3f,\"peak_alloc_bytes\":%zu,"
+                "\"peak_rss_bytes\":%zu",
+                first ? "" : ",\n", corpus->name, size, r.tokens, r.best_seconds, r.total_seconds / runs,
+                mb / r.best_seconds, r.tokens / r.best_seconds, size ? (double)r.best_cycles / size : 0.0,
+                r.peak_alloc, os_peak_memory());
+            if (mode == BENCH_MODE_PACKED) {
+                printf(",\"packed_bytes_per_token\":%.3f,\"decode_seconds\":%.6f,\"decode_tokens_per_s\":%.0f",
+                    r.tokens ? (double)r.packed_bytes / r.tokens : 0.0, r.best_decode_seconds, 
+                    r.best_decode_seconds > 0 ? r.tokens / r.best_decode_seconds : 0.0);
+            }
+            printf("}");
+            fflush(stdout);
+            first = false;
+        }
+    }
+    printf("\n]}\n");
+
+    remove(path);
+    free(data);
+    array_free(sizes, system_allocator);
+    return 0;
+}
@@ -0,0 +1,205 @@
+//
+// Hash vs Flat_Hash on identifier keys
+// Identifiers are collected from the files given on the command line (directories are searched
+// recursively, default is `src`) and hashed like Atom_Table does. Each table is timed building the
+// set of distinct names, looking up every occurrence in file order, so frequent names are hit as
+// often as the lexer hits them, and looking up names that aren't in the table.
+//
+
+#include "foundation/basic.h"
+#include "foundation/array.h"
+#include "foundation/flat_hash.h"
+#include "foundation/hash.h"
+#include "foundation/murmur_hash64.h"
+#include "foundation/os_helper.h"
+#include "char_class.h"
+
+// Every measurement is repeated until it covers at least this many operations
+#define MIN_OPS 20000000
+
+typedef struct Bench_Keys {
+    // Distinct keys in the order they first appear
+    uint64_t *unique;
+    // Key of every identifier occurrence
+    uint64_t *occurrences;
+    uint64_t *missing;
+    Flat_Hash seen;
+} Bench_Keys;
+
+#if defined(SCAN_BLOCK)
+static inline uint32_t scan__ident_mask(const uint8_t *p)
+{
+    Scan_Vec x = scan__load(p);
+    Scan_Vec lower = scan__or(x, scan__set1(0x20));
+    Scan_Vec m = scan__or(scan__in_range(lower, 'a', 'z'), scan__in_range(x, '0', '9'));
+    return scan__mask(scan__or(m, scan__eq(x, scan__set1('_'))));
+}
+#endif
+
+// Returns the end of the run of [A-Za-z0-9_] starting at `pos`
+static uint64_t scan_identifier(const uint8_t *data, uint64_t pos, uint64_t size)
+{
+#if defined(SCAN_BLOCK)
+    while (pos + SCAN_BLOCK <= size) {
+        uint32_t m = ~scan__ident_mask(data + pos) & SCAN_FULL_MASK;
+        if (m)
+            return pos + bits_ctz32(m);
+        pos += SCAN_BLOCK;
+    }
+#endif
+    return scan_class_run(data, pos, size, CHAR_IDENT);
+}
+
+static void collect_file(const char *path, void *user_data)
+{
+    Bench_Keys *keys = user_data;
+    uint64_t size = 0;
+    const uint8_t *data = os_map_file(path, &size);
+    if (!data)
+        return;
+
+    uint64_t pos = 0;
+    while (pos < size) {
+        if (!(char_class[data[pos]] & CHAR_IDENT_START)) {
+            ++pos;
+            continue;
+        }
+        uint64_t end = scan_identifier(data, pos + 1, size);
+        uint64_t key = murmur_hash64a(data + pos, (uint32_t)(end - pos), 0);
+        array_push(keys->occurrences, key, system_allocator);
+        if (!flat_hash_has(&keys->seen, key)) {
+            flat_hash_add(&keys->seen, key, 1, system_allocator);
+            array_push(keys->unique, key, system_allocator);
+            // Same name hashed with another seed, a key of the same shape that is never added
+            array_push(keys->missing, murmur_hash64a(data + pos, (uint32_t)(end - pos), 1), system_allocator);
+        }
+        pos = end;
+    }
+    os_unmap_file(data, size);
+}
+
+typedef struct Bench_Result {
+    double build_ns;
+    double hit_ns;
+    double miss_ns;
+    uint64_t bytes;
+    uint64_t checksum;
+} Bench_Result;
+
+static uint64_t rounds_for(uint64_t n)
+{
+    return n ? (MIN_OPS + n - 1) / n : 1;
+}
+
+static Bench_Result bench_hash(const Bench_Keys *keys)
+{
+    Bench_Result r = { 0 };
+    uint64_t num_unique = array_size(keys->unique);
+    uint64_t num_occurrences = array_size(keys->occurrences);
+    Hash hash = { 0 };
+
+    uint64_t rounds = rounds_for(num_unique);
+    uint64_t start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        hash_free(&hash, system_allocator);
+        for (uint64_t i = 0; i < num_unique; ++i)
+            hash_add(&hash, keys->unique[i], i + 1, system_allocator);
+    }
+    r.build_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_unique);
+    r.bytes = hash.num_buckets * (sizeof(*hash.keys) + sizeof(*hash.values));
+
+    rounds = rounds_for(num_occurrences);
+    start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (uint64_t i = 0; i < num_occurrences; ++i)
+            r.checksum += hash_get(&hash, keys->occurrences[i]);
+    }
+    r.hit_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_occurrences);
+
+    rounds = rounds_for(num_unique);
+    start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (uint64_t i = 0; i < num_unique; ++i)
+            r.checksum += hash_get(&hash, keys->missing[i]);
+    }
+    r.miss_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_unique);
+
+    hash_free(&hash, system_allocator);
+    return r;
+}
+
+static Bench_Result bench_flat_hash(const Bench_Keys *keys)
+{
+    Bench_Result r = { 0 };
+    uint64_t num_unique = array_size(keys->unique);
+    uint64_t num_occurrences = array_size(keys->occurrences);
+    Flat_Hash hash = { 0 };
+
+    uint64_t rounds = rounds_for(num_unique);
+    uint64_t start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        flat_hash_free(&hash, system_allocator);
+        for (uint64_t i = 0; i < num_unique; ++i)
+            flat_hash_add(&hash, keys->unique[i], i + 1, system_allocator);
+    }
+    r.build_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_unique);
+    r.bytes = flat_hash__alloc_size(hash.capacity);
+
+    rounds = rounds_for(num_occurrences);
+    start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (uint64_t i = 0; i < num_occurrences; ++i)
+            r.checksum += flat_hash_get(&hash, keys->occurrences[i]);
+    }
+    r.hit_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_occurrences);
+
+    rounds = rounds_for(num_unique);
+    start = os_time_now();
+    for (uint64_t round = 0; round < rounds; ++round) {
+        for (uint64_t i = 0; i < num_unique; ++i)
+            r.checksum += flat_hash_get(&hash, keys->missing[i]);
+    }
+    r.miss_ns = os_time_delta(os_time_now(), start) * 1e9 / (double)(rounds * num_unique);
+
+    flat_hash_free(&hash, system_allocator);
+    return r;
+}
+
+static void print_result(const char *name, Bench_Result r, bool last)
+{
+    printf("  {\"table\":\"%s\",\"build_ns\":%.2f,\"hit_ns\":%.2f,\"miss_ns\":%.2f,\"bytes\":%zu}%s\n",
+        name, r.build_ns, r.hit_ns, r.miss_ns, r.bytes, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    Bench_Keys keys = { 0 };
+    if (argc < 2)
+        os_list_files("src", collect_file, &keys);
+    for (int i = 1; i < argc; ++i) {
+        if (os_is_directory(argv[i]))
+            os_list_files(argv[i], collect_file, &keys);
+        else
+            collect_file(argv[i], &keys);
+    }
+
+    if (array_size(keys.unique) == 0) {
+        printf("No identifiers found\n");
+        return 1;
+    }
+
+    Bench_Result hash = bench_hash(&keys);
+    Bench_Result flat_hash = bench_flat_hash(&keys);
+
+    printf("{\"unique\":%zu,\"occurrences\":%zu,\"results\":[\n",
+        array_size(keys.unique), array_size(keys.occurrences));
+    print_result("hash", hash, false);
+    print_result("flat_hash", flat_hash, true);
+    printf("],\"checksums_match\":%s}\n", hash.checksum == flat_hash.checksum ? "true" : "false");
+
+    flat_hash_free(&keys.seen, system_allocator);
+    array_free(keys.unique, system_allocator);
+    array_free(keys.occurrences, system_allocator);
+    array_free(keys.missing, system_allocator);
+    return 0;
+}
@@ -1,5 +1,10 @@
 -- premake5.lua
 
+newoption {
+    trigger = "instrument",
+    description = "Count cycles, tokens, atom and hash lookups on the lexer hot path and print a report"
+}
+
 workspace "workspace"
     configurations { "Debug", "Release" }
     language "C"
@@ -41,6 +46,27 @@ filter "platforms:Win64"
     }
     linkoptions { "/ignore:4099" }
 
+filter "system:linux"
+    platforms { "Linux64" }
+
+filter "platforms:Linux64"
+    defines { 
+        "OS_LINUX", 
+        "_GNU_SOURCE"
+    }
+    includedirs "src"
+    architecture "x64"
+    buildoptions { "-std=gnu11" }
+    disablewarnings {
+        "unused-parameter",     -- Same as 4100 on MSVC.
+        "pointer-sign",         -- Same as 4057 on MSVC.
+        "implicit-fallthrough", -- Intentional in murmur_hash64a.
+    }
+    links { "m", "pthread" }
+
+filter "options:instrument"
+    defines { "LEXER_INSTRUMENT" }
+
 filter "configurations:Debug"
     defines { "DEBUG_MODE" }
     symbols "On"
@@ -49,7 +75,53 @@ filter "configurations:Release"
     defines { "RELEASE_MODE" }
     optimize "On"
 
+-- Turns src/tokens.spec into lexer_tokens.h and lexer_dfa.h, it only writes files that changed
+project "dfa_gen"
+    kind "ConsoleApp"
+    targetname "dfa_gen"
+    files { "tools/dfa_gen.c", "src/foundation/**.h", "src/foundation/**.c" }
+
+-- Prebuild commands run from the project location, which is bin
+local dfa_gen_command = '"%{cfg.targetdir}/dfa_gen" "../src/tokens.spec" "../src/lexer_tokens.h" "../src/lexer_dfa.h"'
+
 project "lexer"
     kind "ConsoleApp"
     targetname "lexer"
-    files { "src/**.h", "src/**.c" }
\ No newline at end of file
+    files { "src/**.h", "src/**.c", "src/tokens.spec" }
+    dependson { "dfa_gen" }
+    prebuildcommands { dfa_gen_command }
+
+project "atom_bench"
+    kind "ConsoleApp"
+    targetname "atom_bench"
+    files { "bench/atom_bench.c", "src/foundation/**.h", "src/foundation/**.c" }
+
+project "hash_bench"
+    kind "ConsoleApp"
+    targetname "hash_bench"
+    files { "bench/hash_bench.c", "src/char_class.h", "src/foundation/**.h", "src/foundation/**.c" }
+
+project "bench"
+    kind "ConsoleApp"
+    targetname "bench"
+    files { "bench/bench.c", "src/**.h", "src/**.c" }
+    removefiles { "src/main.c" }
+    dependson { "dfa_gen" }
+    prebuildcommands { dfa_gen_command }
+
+-- Relexes random edits and compares the stream with a full lex, a mismatch fails the build
+project "relex_test"
+    kind "ConsoleApp"
+    targetname "relex_test"
+    files { "tests/relex_test.c", "src/**.h", "src/**.c" }
+    removefiles { "src/main.c" }
+    dependson { "dfa_gen" }
+    prebuildcommands { dfa_gen_command }
+    postbuildcommands { '"%{cfg.buildtarget.abspath}"' }
+
+-- Checks the number parsers against strtod and strtoull, a mismatch fails the build
+project "parse_number_test"
+    kind "ConsoleApp"
+    targetname "parse_number_test"
+    files { "tests/parse_number_test.c", "src/foundation/**.h", "src/foundation/**.c" }
+    postbuildcommands { '"%{cfg.buildtarget.abspath}"' }
@@ -0,0 +1,329 @@
+#pragma once
+#include "foundation/basic.h"
+#include "foundation/bits.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Byte classes of the ASCII range
+// What's left of the first character dispatch since the DFA took it over: the skip class used by
+// `scan_skip`, and the identifier classes `utf8_is_xid_start`/`utf8_is_xid_continue` use below 0x80.
+enum {
+    CHAR_SKIP        = 1 << 0, // Whitespace and control characters
+    CHAR_IDENT_START = 1 << 1,
+    CHAR_IDENT       = 1 << 2,
+};
+
+#define S CHAR_SKIP
+#define I (CHAR_IDENT_START | CHAR_IDENT)
+#define D CHAR_IDENT
+
+static const uint8_t char_class[256] = {
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, // 00
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, // 10
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 20
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // 30
+    0, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 40
+    I, I, I, I, I, I, I, I, I, I, I, 0, 0, 0, 0, I, // 50
+    0, I, I, I, I, I, I, I, I, I, I, I, I, I, I, I, // 60
+    I, I, I, I, I, I, I, I, I, I, I, 0, 0, 0, 0, S, // 70
+};
+
+#undef S
+#undef I
+#undef D
+
+//
+// Run scanners
+// The lexer skips whitespace, strings, comments and runs of non-ASCII bytes with these, and the line
+// index counts newlines with them. Each computes a bitmask of the matching bytes of a whole block and
+// returns the end of the run. Blocks are only loaded while they fit inside `size`, the tail is handled
+// one byte at a time.
+//
+
+#if defined(__AVX2__)
+
+#define SCAN_BLOCK 32
+typedef __m256i Scan_Vec;
+#define scan__load(p)           _mm256_loadu_si256((const __m256i *)(p))
+#define scan__set1(c)           _mm256_set1_epi8((char)(c))
+#define scan__or(a, b)          _mm256_or_si256(a, b)
+#define scan__eq(a, b)          _mm256_cmpeq_epi8(a, b)
+#define scan__sub(a, b)         _mm256_sub_epi8(a, b)
+#define scan__min(a, b)         _mm256_min_epu8(a, b)
+#define scan__mask(v)           ((uint32_t)_mm256_movemask_epi8(v))
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#define SCAN_BLOCK 16
+typedef __m128i Scan_Vec;
+#define scan__load(p)           _mm_loadu_si128((const __m128i *)(p))
+#define scan__set1(c)           _mm_set1_epi8((char)(c))
+#define scan__or(a, b)          _mm_or_si128(a, b)
+#define scan__eq(a, b)          _mm_cmpeq_epi8(a, b)
+#define scan__sub(a, b)         _mm_sub_epi8(a, b)
+#define scan__min(a, b)         _mm_min_epu8(a, b)
+#define scan__mask(v)           ((uint32_t)_mm_movemask_epi8(v))
+
+#endif
+
+#if defined(SCAN_BLOCK)
+
+#define SCAN_FULL_MASK ((uint32_t)(((uint64_t)1 << SCAN_BLOCK) - 1))
+
+// Unsigned lo <= x <= hi
+static inline Scan_Vec scan__in_range(Scan_Vec x, uint8_t lo, uint8_t hi)
+{
+    Scan_Vec t = scan__sub(x, scan__set1(lo));
+    return scan__eq(scan__min(t, scan__set1(hi - lo)), t);
+}
+
+static inline uint32_t scan__skip_mask(const uint8_t *p)
+{
+    Scan_Vec x = scan__load(p);
+    return scan__mask(scan__or(scan__in_range(x, 0x00, 0x20), scan__eq(x, scan__set1(0x7f))));
+}
+
+static inline uint32_t scan__newline_mask(const uint8_t *p)
+{
+    return scan__mask(scan__eq(scan__load(p), scan__set1('\n')));
+}
+
+#endif
+
+static inline uint64_t scan_class_run(const uint8_t *data, uint64_t pos, uint64_t size, uint8_t cls)
+{
+    while (pos < size && (char_class[data[pos]] & cls))
+        ++pos;
+    return pos;
+}
+
+// Returns the end of the run of CHAR_SKIP bytes starting at `pos`
+static inline uint64_t scan_skip(const uint8_t *data, uint64_t pos, uint64_t size)
+{
+#if defined(SCAN_BLOCK)
+    while (pos + SCAN_BLOCK <= size) {
+        uint32_t end = ~scan__skip_mask(data + pos) & SCAN_FULL_MASK;
+        if (end)
+            return pos + bits_ctz32(end);
+        pos += SCAN_BLOCK;
+    }
+#endif
+    return scan_class_run(data, pos, size, CHAR_SKIP);
+}
+
+// Same as `scan_skip`, but newlines inside the run are added to `*lines`, `*line_start` is set to the byte after the last one.
+static inline uint64_t scan_whitespace(const uint8_t *data, uint64_t pos, uint64_t size, 
+    int *lines, uint64_t *line_start)
+{
+#if defined(SCAN_BLOCK)
+    while (pos + SCAN_BLOCK <= size) {
+        uint32_t end = ~scan__skip_mask(data + pos) & SCAN_FULL_MASK;
+        uint32_t nl = scan__newline_mask(data + pos);
+        if (end)
+            nl &= (1u << bits_ctz32(end)) - 1;
+        if (nl) {
+            *lines += bits_popcount32(nl);
+            *line_start = pos + bits_highest32(nl) + 1;
+        }
+        if (end)
+            return pos + bits_ctz32(end);
+        pos += SCAN_BLOCK;
+    }
+#endif
+    while (pos < size && (char_class[data[pos]] & CHAR_SKIP)) {
+        if (data[pos] == '\n') {
+            *lines += 1;
+            *line_start = pos + 1;
+        }
+        ++pos;
+    }
+    return pos;
+}
+
+//
+// Structural scans of strings and comments
+// In the style of simdjson, 64 bytes at a time are turned into bitmasks of the bytes that can end
+// them (quotes, backslashes, `*/`) and of newlines. Escapes are resolved with carry propagating
+// arithmetic on the backslash mask, so the lexer jumps over a string or comment a block at a time
+// however many escapes and lines it has. The blocks are loaded as SCAN_BLOCK sized pieces.
+//
+
+#if defined(SCAN_BLOCK)
+
+#define SCAN_WIDE_BLOCK 64
+
+// Masks of the bytes equal to `a`, equal to `b`, of newlines and of non-ASCII bytes in the 64 bytes at `p`
+static inline void scan__structural64(const uint8_t *p, uint8_t a, uint8_t b, 
+    uint64_t *a_mask, uint64_t *b_mask, uint64_t *nl_mask, uint64_t *high_mask)
+{
+    uint64_t ma = 0, mb = 0, nl = 0, high = 0;
+    for (uint32_t i = 0; i < SCAN_WIDE_BLOCK; i += SCAN_BLOCK) {
+        Scan_Vec x = scan__load(p + i);
+        ma |= (uint64_t)scan__mask(scan__eq(x, scan__set1(a))) << i;
+        mb |= (uint64_t)scan__mask(scan__eq(x, scan__set1(b))) << i;
+        nl |= (uint64_t)scan__mask(scan__eq(x, scan__set1('\n'))) << i;
+        high |= (uint64_t)scan__mask(x) << i;
+    }
+    *a_mask = ma;
+    *b_mask = mb;
+    *nl_mask = nl;
+    *high_mask = high;
+}
+
+// Mask of the bytes right after an odd length run of backslashes, which are the escaped ones
+// `*carry` is 1 when the previous block ended inside an odd run, and is set for the next block.
+static inline uint64_t scan__escaped64(uint64_t backslash, uint64_t *carry)
+{
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    uint64_t starts = backslash & ~(backslash << 1);
+    // A run continued from the previous block counts as starting on the parity it had there
+    uint64_t even_start_mask = even_bits ^ *carry;
+    uint64_t even_starts = starts & even_start_mask;
+    uint64_t odd_starts = starts & ~even_start_mask;
+    // Adding the first bit of a run to the mask carries out to the byte after it
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    uint64_t next_carry = odd_carries < backslash;
+    odd_carries |= *carry;
+    *carry = next_carry;
+    // The run is odd when it ends on a different parity than it started on
+    uint64_t even_start_odd_end = even_carries & ~backslash & ~even_bits;
+    uint64_t odd_start_even_end = odd_carries & ~backslash & even_bits;
+    return even_start_odd_end | odd_start_even_end;
+}
+
+// Adds the newlines in `nl` of the block at `pos` to the line count
+static inline void scan__count_lines64(uint64_t nl, uint64_t pos, int *lines, uint64_t *line_start)
+{
+    if (nl) {
+        *lines += bits_popcount64(nl);
+        *line_start = pos + bits_highest64(nl) + 1;
+    }
+}
+
+#endif
+
+// Returns the offset of the `quote` that ends a string whose contents start at `pos`, or `size` if
+// it isn't closed. A quote after an odd number of backslashes is escaped. Newlines inside the string
+// are added to `*lines` as in `scan_whitespace`, `*non_ascii` is set if it has a byte >= 0x80.
+static inline uint64_t scan_string(const uint8_t *data, uint64_t pos, uint64_t size, uint8_t quote,
+    int *lines, uint64_t *line_start, bool *non_ascii)
+{
+    uint64_t escaped = 0;
+#if defined(SCAN_BLOCK)
+    for (; pos + SCAN_WIDE_BLOCK <= size; pos += SCAN_WIDE_BLOCK) {
+        uint64_t quotes, backslash, nl, high;
+        scan__structural64(data + pos, quote, '\\', &quotes, &backslash, &nl, &high);
+        uint64_t end = quotes & ~scan__escaped64(backslash, &escaped);
+        if (end) {
+            uint64_t before = (end & (0 - end)) - 1;
+            scan__count_lines64(nl & before, pos, lines, line_start);
+            *non_ascii |= (high & before) != 0;
+            return pos + bits_ctz64(end);
+        }
+        scan__count_lines64(nl, pos, lines, line_start);
+        *non_ascii |= high != 0;
+    }
+#endif
+    for (; pos < size; ++pos) {
+        uint8_t c = data[pos];
+        *non_ascii |= c >= 0x80;
+        if (c == '\n') {
+            *lines += 1;
+            *line_start = pos + 1;
+        }
+        if (escaped)
+            escaped = 0;
+        else if (c == '\\')
+            escaped = 1;
+        else if (c == quote)
+            return pos;
+    }
+    return pos;
+}
+
+// Returns the offset right after the `*/` that ends a block comment whose contents start at `pos`, or
+// `size` if it isn't closed. Newlines are counted as in `scan_string`.
+static inline uint64_t scan_block_comment(const uint8_t *data, uint64_t pos, uint64_t size, 
+    int *lines, uint64_t *line_start)
+{
+    // Set when the byte before the block is a `*`
+    uint64_t star = 0;
+#if defined(SCAN_BLOCK)
+    for (; pos + SCAN_WIDE_BLOCK <= size; pos += SCAN_WIDE_BLOCK) {
+        uint64_t stars, slashes, nl, high;
+        scan__structural64(data + pos, '*', '/', &stars, &slashes, &nl, &high);
+        uint64_t end = slashes & ((stars << 1) | star);
+        if (end) {
+            scan__count_lines64(nl & ((end & (0 - end)) - 1), pos, lines, line_start);
+            return pos + bits_ctz64(end) + 1;
+        }
+        scan__count_lines64(nl, pos, lines, line_start);
+        star = stars >> 63;
+    }
+#endif
+    for (; pos < size; ++pos) {
+        uint8_t c = data[pos];
+        if (c == '\n') {
+            *lines += 1;
+            *line_start = pos + 1;
+        }
+        if (star && c == '/')
+            return pos + 1;
+        star = c == '*';
+    }
+    return pos;
+}
+
+// Returns the offset of the first byte >= 0x80 in [pos, end), or `end` if there is none
+// Blocks are loaded past `end` while they fit inside `size`, so a short run is a single test.
+static inline uint64_t scan_non_ascii(const uint8_t *data, uint64_t pos, uint64_t end, uint64_t size)
+{
+#if defined(SCAN_BLOCK)
+    for (; pos < end && pos + SCAN_BLOCK <= size; pos += SCAN_BLOCK) {
+        uint32_t high = scan__mask(scan__load(data + pos));
+        if (high) {
+            pos += bits_ctz32(high);
+            return pos < end ? pos : end;
+        }
+    }
+    if (pos >= end)
+        return end;
+#endif
+    while (pos < end && data[pos] < 0x80)
+        ++pos;
+    return pos;
+}
+
+// Returns the offset of the first newline at or after `pos`, or `size` if there is none
+static inline uint64_t scan_line_end(const uint8_t *data, uint64_t pos, uint64_t size)
+{
+#if defined(SCAN_BLOCK)
+    for (; pos + SCAN_BLOCK <= size; pos += SCAN_BLOCK) {
+        uint32_t nl = scan__newline_mask(data + pos);
+        if (nl)
+            return pos + bits_ctz32(nl);
+    }
+#endif
+    while (pos < size && data[pos] != '\n')
+        ++pos;
+    return pos;
+}
+
+// Number of newlines in [from, to)
+static inline uint64_t scan_count_newlines(const uint8_t *data, uint64_t from, uint64_t to)
+{
+    uint64_t count = 0;
+    uint64_t pos = from;
+#if defined(SCAN_BLOCK)
+    for (; pos + SCAN_BLOCK <= to; pos += SCAN_BLOCK)
+        count += bits_popcount32(scan__newline_mask(data + pos));
+#endif
+    for (; pos < to; ++pos)
+        count += data[pos] == '\n';
+    return count;
+}
@@ -18,6 +18,8 @@ static inline uint64_t align_size(uint64_t size, uint64_t align)
     return ((size + align - 1) / align) * align;
 }
 
+// Every allocation reserves `reserve_size` bytes of address space up front and only commits the pages
+// it uses, so growing an allocation commits more pages at the same address and never copies
 static void *fixed_vm_alloc(Allocator *a, void *old_ptr, uint64_t old_size, uint64_t new_size,
     const char *file, uint32_t line)
 {
@@ -37,14 +39,16 @@ static void *fixed_vm_alloc(Allocator *a, void *old_ptr, uint64_t old_size, uint
     void *new_ptr = 0;
     if (old_ptr == 0 && new_size > 0) {
         new_ptr = os_reserve(reserve_size);
+        if (new_ptr == 0) {
+            printf("Fixed virtual memory allocator failed to reserve %zuB (%s:%u)\n", reserve_size, file, line);
+            return 0;
+        }
         os_commit(new_ptr, new_size);
     } else if (new_size > 0) {
         new_ptr = old_ptr;
         os_commit((char *)new_ptr + old_size, new_size - old_size);
-    } else if (new_size == 0) {
-        os_release(old_ptr);
-        // os_decommit(old_ptr, old_size);
-        new_ptr = 0;
+    } else if (old_ptr) {
+        os_release(old_ptr, reserve_size);
     }
 
     return new_ptr;
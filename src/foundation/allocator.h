@@ -8,6 +8,8 @@ typedef struct Allocator {
 } Allocator;
 
 // Fixed address virtual memory allocator
+// Each allocation gets its own `reserve_size` bytes of address space and grows in place up to it,
+// so pointers into it stay valid and growing never copies. Use it for arrays that grow large.
 Allocator allocator_create_fixed_vm(uint64_t reserve_size);
 
 #define c_alloc(a, sz)                     (a)->alloc_cb(a, 0, 0, sz, __FILE__, __LINE__)
@@ -0,0 +1,81 @@
+#include "arena.h"
+#include "foundation/os_helper.h"
+
+// Commits are batched so that small pushes don't cost one syscall per page
+#define ARENA_COMMIT_SIZE KB(64)
+
+struct Arena_Chunk {
+    Arena_Chunk *prev;
+    uint64_t reserved;
+};
+
+static inline uint64_t align_size(uint64_t size, uint64_t align)
+{
+    return ((size + align - 1) / align) * align;
+}
+
+static void arena__commit(Arena *arena, uint8_t *to)
+{
+    if (to <= arena->committed)
+        return;
+    uint64_t offset = (uint64_t)(to - (uint8_t *)arena->chunk);
+    uint8_t *new_committed = (uint8_t *)arena->chunk + align_size(offset, ARENA_COMMIT_SIZE);
+    if (new_committed > arena->end)
+        new_committed = arena->end;
+    os_commit(arena->committed, (uint64_t)(new_committed - arena->committed));
+    arena->committed = new_committed;
+}
+
+static bool arena__new_chunk(Arena *arena, uint64_t min_size)
+{
+    uint64_t reserve = align_size(min_size + sizeof(Arena_Chunk), ARENA_COMMIT_SIZE);
+    if (reserve < arena->chunk_size)
+        reserve = arena->chunk_size;
+
+    Arena_Chunk *chunk = os_reserve(reserve);
+    if (chunk == 0)
+        return false;
+    os_commit(chunk, ARENA_COMMIT_SIZE);
+
+    chunk->prev = arena->chunk;
+    chunk->reserved = reserve;
+    arena->chunk = chunk;
+    arena->cursor = (uint8_t *)(chunk + 1);
+    arena->committed = (uint8_t *)chunk + ARENA_COMMIT_SIZE;
+    arena->end = (uint8_t *)chunk + reserve;
+    return true;
+}
+
+Arena arena_create(uint64_t chunk_size)
+{
+    Arena res = {
+        .chunk_size = align_size(chunk_size ? chunk_size : MB(1), ARENA_COMMIT_SIZE),
+    };
+    return res;
+}
+
+void arena_destroy(Arena *arena)
+{
+    Arena_Chunk *chunk = arena->chunk;
+    while (chunk) {
+        Arena_Chunk *prev = chunk->prev;
+        os_release(chunk, chunk->reserved);
+        chunk = prev;
+    }
+    *arena = (Arena) { .chunk_size = arena->chunk_size };
+}
+
+void *arena_push(Arena *arena, uint64_t size, uint64_t align)
+{
+    uint8_t *p = (uint8_t *)align_size((uint64_t)arena->cursor, align);
+    if (arena->chunk == 0 || p + size > arena->end) {
+        if (!arena__new_chunk(arena, size + align)) {
+            printf("Arena out of memory! Failed to reserve a chunk for %zuB\n", size);
+            return 0;
+        }
+        p = (uint8_t *)align_size((uint64_t)arena->cursor, align);
+    }
+    arena__commit(arena, p + size);
+    arena->cursor = p + size;
+    return p;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "foundation/basic.h"
+
+typedef struct Arena_Chunk Arena_Chunk;
+
+// Chunked bump allocator on top of reserved virtual memory
+// Each chunk reserves `chunk_size` bytes and commits them page by page as the cursor advances.
+// When a chunk is full a new one is reserved and chained, so pointers are never moved.
+// Individual allocations can't be freed, everything is released at once by `arena_destroy`.
+typedef struct Arena {
+    uint64_t chunk_size;
+    Arena_Chunk *chunk;
+    uint8_t *cursor;
+    uint8_t *committed;
+    uint8_t *end;
+} Arena;
+
+Arena arena_create(uint64_t chunk_size);
+void arena_destroy(Arena *arena);
+
+void *arena_push(Arena *arena, uint64_t size, uint64_t align);
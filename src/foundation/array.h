@@ -31,7 +31,7 @@ typedef struct Array_Header {
     array_push_at(a, v, allocator, __FILE__, __LINE__)
 
 #define array_join_at(a, v, n, allocator, file, line) \
-    ((n) ? ((array_ensure_at(a, array_size(a) + n, allocator, file, line), memcpy(a + array_size(a), v, n * sizeof(*(a))), array_header(a)->size += n), 0) : 0)
+    ((n) ? ((array_ensure_at(a, array_size(a) + (n), allocator, file, line), memcpy((a) + array_size(a), v, (n) * sizeof(*(a))), array_header(a)->size += (n)), 0) : 0)
     
 #define array_join(a, v, n, allocator) \
     array_join_at(a, v, n, allocator, __FILE__, __LINE__)
@@ -60,6 +60,10 @@ typedef struct Array_Header {
 #define array_grow(a, n, allocator) \
     array_grow_at(a, n, allocator, __FILE__, __LINE__)
 
+// Replace `remove` items at `at` with `n` items from `src`
+#define array_splice(a, at, remove, src, n, allocator) \
+    (*((void **)&(a)) = array__splice_internal((void *)a, at, remove, src, n, sizeof(*(a)), allocator, __FILE__, __LINE__))
+
 static inline void *array__set_capacity_internal(void *arr, uint64_t new_capacity, uint64_t item_size,
     struct Allocator *allocator, const char *file, uint32_t line)
 {
@@ -87,3 +91,19 @@ static inline void *array__grow_internal(void *arr, uint64_t to_at_least, uint64
     const uint64_t new_capacity = min_capacity > to_at_least ? min_capacity : to_at_least;
     return array__set_capacity_internal(arr, new_capacity, item_size, allocator, file, line);
 }
+
+static inline void *array__splice_internal(void *arr, uint64_t at, uint64_t remove, const void *src, uint64_t n,
+    uint64_t item_size, struct Allocator *allocator, const char *file, uint32_t line)
+{
+    const uint64_t size = array_size(arr);
+    const uint64_t new_size = size - remove + n;
+    arr = array__grow_internal(arr, new_size, item_size, allocator, file, line);
+    if (!arr)
+        return arr;
+    uint8_t *p = (uint8_t *)arr;
+    memmove(p + (at + n) * item_size, p + (at + remove) * item_size, (size - at - remove) * item_size);
+    if (n)
+        memcpy(p + at * item_size, src, n * item_size);
+    array_header(arr)->size = new_size;
+    return arr;
+}
@@ -1,53 +1,169 @@
 #include "atom.h"
 #include "foundation/allocator.h"
-#include "foundation/hash.h"
+#include "foundation/arena.h"
+#include "foundation/atomic.h"
+#include "foundation/flat_hash.h"
+#include "foundation/instrument.h"
 #include "foundation/murmur_hash64.h"
+#include "foundation/os_helper.h"
+
+// The table is split into shards selected by the top bits of the hash, each with its own lock,
+// lookup and arena. Threads only contend when they touch the same shard at the same time.
+#define ATOM_SHARD_BITS 6
+#define ATOM_NUM_SHARDS (1 << ATOM_SHARD_BITS)
+
+#define ATOM_CACHE_LINE 64
+#define ATOM_SHARD_SIZE ((sizeof(Os_Mutex) + sizeof(Flat_Hash) + sizeof(Arena) + ATOM_CACHE_LINE - 1) \
+    / ATOM_CACHE_LINE * ATOM_CACHE_LINE)
+
+// Padded to whole cache lines, so with the array aligned to a line no two shards share one
+typedef union Atom_Shard {
+    struct {
+        Os_Mutex lock;
+        Flat_Hash lookup;
+        // Atom headers and string bytes are bump allocated
+        Arena arena;
+    };
+    uint8_t pad[ATOM_SHARD_SIZE];
+} Atom_Shard;
+
+_Static_assert(sizeof(Atom_Shard) == ATOM_SHARD_SIZE, "Atom_Shard fields don't fit its padding");
+_Static_assert(sizeof(Atom_Shard) % ATOM_CACHE_LINE == 0, "Atom_Shard isn't a whole number of cache lines");
 
 struct Atom_Table {
-    Allocator allocator;
-    Hash lookup;
+    Arena arena;
+    Atom_Shard *shards;
+    // ID to Atom, reserved for ATOM_MAX_IDS up front so it never moves and readers need no lock.
+    // Committed in ATOM_COMMIT_SIZE steps under `id_lock`.
+    Atom **by_id;
+    uint64_t committed;
+    // IDs are taken under `id_lock` and `num_atoms` is only stored once `by_id` holds the new entry
+    uint64_t num_atoms;
+    Os_Mutex id_lock;
 };
 
+#define ATOM_COMMIT_SIZE KB(64)
+
+static inline Atom_Shard *atom_shard(Atom_Table *table, uint64_t key)
+{
+    return &table->shards[key >> (64 - ATOM_SHARD_BITS)];
+}
+
 Atom_Table *atom_table_create(uint64_t capacity)
 {
-    Allocator allocator = allocator_create_fixed_vm(capacity);
-    Atom_Table *table = c_alloc(&allocator, sizeof(*table));
-    table->allocator = allocator;
-    table->lookup = (Hash) { 0 };
+    Arena arena = arena_create(sizeof(Atom_Table) + sizeof(Atom_Shard) * ATOM_NUM_SHARDS);
+    Atom_Table *table = arena_push(&arena, sizeof(*table), 8);
+    // Keep shards on separate cache lines
+    table->shards = arena_push(&arena, sizeof(Atom_Shard) * ATOM_NUM_SHARDS, ATOM_CACHE_LINE);
+    table->arena = arena;
+    table->by_id = os_reserve(ATOM_MAX_IDS * sizeof(Atom *));
+    table->committed = 0;
+    table->num_atoms = 0;
+    os_mutex_init(&table->id_lock);
+
+    for (uint32_t i = 0; i < ATOM_NUM_SHARDS; ++i) {
+        Atom_Shard *shard = &table->shards[i];
+        os_mutex_init(&shard->lock);
+        shard->lookup = (Flat_Hash) { 0 };
+        shard->arena = arena_create(capacity / ATOM_NUM_SHARDS);
+    }
     return table;
 }
 
 void atom_table_destroy(Atom_Table *table)
 {
-    Allocator *a = &table->allocator;
-    hash_free(&table->lookup, a);
-    c_free(a, table, (uint64_t)a->user_data);
+    for (uint32_t i = 0; i < ATOM_NUM_SHARDS; ++i) {
+        Atom_Shard *shard = &table->shards[i];
+        flat_hash_free(&shard->lookup, system_allocator);
+        arena_destroy(&shard->arena);
+        os_mutex_destroy(&shard->lock);
+    }
+    os_release(table->by_id, ATOM_MAX_IDS * sizeof(Atom *));
+    os_mutex_destroy(&table->id_lock);
+    // The table itself lives in the arena, so release through a copy
+    Arena arena = table->arena;
+    arena_destroy(&arena);
+}
+
+// Gives `atom` the next ID and publishes it, returns false if the table already holds ATOM_MAX_IDS atoms
+static bool atom_assign_id(Atom_Table *table, Atom *atom)
+{
+    os_mutex_lock(&table->id_lock);
+    uint64_t id = table->num_atoms;
+    if (id >= ATOM_MAX_IDS) {
+        os_mutex_unlock(&table->id_lock);
+        return false;
+    }
+    uint64_t needed = (id + 1) * sizeof(Atom *);
+    while (table->committed < needed) {
+        os_commit((uint8_t *)table->by_id + table->committed, ATOM_COMMIT_SIZE);
+        table->committed += ATOM_COMMIT_SIZE;
+    }
+    atom->id = (uint32_t)id;
+    table->by_id[id] = atom;
+    atomic_store_u64(&table->num_atoms, id + 1);
+    os_mutex_unlock(&table->id_lock);
+    return true;
 }
 
 Atom *atom_add(Atom_Table *table, const char *str, uint32_t len)
 {
     uint64_t key = murmur_hash64a(str, len, 0);
+    Atom_Shard *shard = atom_shard(table, key);
 
-    Atom *res = (Atom *)hash_get(&table->lookup, key);
-    if (res != 0)
-        return res;
-
-    // Header + string len + terminator
-    uint64_t needed_size = sizeof(Atom) + len + 1;
-    Atom *atom = c_alloc(&table->allocator, needed_size);
-    memset(atom, 0, needed_size);
-    atom->hash = key;
-    atom->str.len = len;
-    atom->str.data = (uint8_t *)atom + sizeof(Atom);
-    memcpy((uint8_t *)atom->str.data, str, len);
-
-    // Store pointer in lookup table
-    hash_add(&table->lookup, key, (uint64_t)atom, &table->allocator);
+    os_mutex_lock(&shard->lock);
+
+    Atom *atom = (Atom *)flat_hash_get(&shard->lookup, key);
+    if (atom == 0) {
+        INSTRUMENT_COUNT(INSTRUMENT_ATOM_MISS);
+        // Checked again when the ID is taken, this only keeps a full table from filling the arenas
+        if (atom_count(table) >= ATOM_MAX_IDS) {
+            printf("Atom table is full! Can't add more than %u atoms\n", (uint32_t)ATOM_MAX_IDS);
+            os_mutex_unlock(&shard->lock);
+            return 0;
+        }
+
+        // Header + string len + terminator
+        uint64_t needed_size = sizeof(Atom) + len + 1;
+        atom = arena_push(&shard->arena, needed_size, 8);
+        atom->hash = key;
+        atom->str.len = len;
+        atom->str.data = (uint8_t *)atom + sizeof(Atom);
+        memcpy((uint8_t *)atom->str.data, str, len);
+        atom->str.data[len] = 0;
+        if (!atom_assign_id(table, atom)) {
+            printf("Atom table is full! Can't add more than %u atoms\n", (uint32_t)ATOM_MAX_IDS);
+            os_mutex_unlock(&shard->lock);
+            return 0;
+        }
+
+        // Store pointer in lookup table
+        flat_hash_add(&shard->lookup, key, (uint64_t)atom, system_allocator);
+    } else {
+        INSTRUMENT_COUNT(INSTRUMENT_ATOM_HIT);
+    }
+
+    os_mutex_unlock(&shard->lock);
     return atom;
 }
 
 Atom *atom_find(Atom_Table *table, const char *str)
 {
     uint64_t key = murmur_hash64a_string(str);
-    return (Atom *)hash_get(&table->lookup, key);
+    Atom_Shard *shard = atom_shard(table, key);
+
+    os_mutex_lock(&shard->lock);
+    Atom *atom = (Atom *)flat_hash_get(&shard->lookup, key);
+    os_mutex_unlock(&shard->lock);
+    return atom;
+}
+
+Atom *atom_get(const Atom_Table *table, uint32_t id)
+{
+    return table->by_id[id];
+}
+
+uint32_t atom_count(const Atom_Table *table)
+{
+    return (uint32_t)atomic_load_u64((volatile uint64_t *)&table->num_atoms);
 }
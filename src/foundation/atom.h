@@ -6,15 +6,30 @@ typedef struct Atom_Table Atom_Table;
 typedef struct Atom {
     uint64_t hash;
     String8 str;
+    // Dense index in the order atoms were added, starting at 0
+    uint32_t id;
 } Atom;
 
+// Upper bound on the number of distinct atoms in one table
+#define ATOM_MAX_IDS (1ULL << 28)
+
+// The table can be used from several threads at once, 
+// every distinct string maps to one canonical Atom no matter which thread added it first.
 Atom_Table *atom_table_create(uint64_t capacity);
 void atom_table_destroy(Atom_Table *table);
 
+// Returns 0 if the string is new and the table already holds ATOM_MAX_IDS atoms
 Atom *atom_add(Atom_Table *table, const char *str, uint32_t len);
 Atom *atom_find(Atom_Table *table, const char *str);
 
-static inline bool atoms_match(Atom *lhs, Atom *rhs)
+// IDs are handed out sequentially, so per-atom data can live in a plain array indexed by `id`.
+// Looking up an ID takes no lock. It is valid for IDs returned by `atom_add` and for every ID below
+// `atom_count`, which only counts atoms whose lookup is already in place.
+Atom *atom_get(const Atom_Table *table, uint32_t id);
+uint32_t atom_count(const Atom_Table *table);
+
+// Atoms are unique per table, so two ids of the same table are equal exactly when their strings are
+static inline bool atoms_match(uint32_t lhs, uint32_t rhs)
 {
-    return lhs->hash == rhs->hash;
+    return lhs == rhs;
 }
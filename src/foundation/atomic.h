@@ -0,0 +1,45 @@
+#pragma once
+#include "foundation/basic.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Sequentially consistent atomics on plain integers
+
+static inline uint64_t atomic_load_u64(volatile uint64_t *p)
+{
+#if defined(_MSC_VER)
+    return (uint64_t)_InterlockedOr64((volatile __int64 *)p, 0);
+#else
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_store_u64(volatile uint64_t *p, uint64_t v)
+{
+#if defined(_MSC_VER)
+    _InterlockedExchange64((volatile __int64 *)p, (__int64)v);
+#else
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Returns the value before the add
+static inline uint64_t atomic_add_u64(volatile uint64_t *p, uint64_t v)
+{
+#if defined(_MSC_VER)
+    return (uint64_t)_InterlockedExchangeAdd64((volatile __int64 *)p, (__int64)v);
+#else
+    return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline bool atomic_cas_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+#if defined(_MSC_VER)
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64 *)p, (__int64)desired, (__int64)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
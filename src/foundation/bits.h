@@ -0,0 +1,70 @@
+#pragma once
+#include "foundation/basic.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit, `x` must be non-zero
+static inline uint32_t bits_ctz32(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (uint32_t)i;
+#else
+    return (uint32_t)__builtin_ctz(x);
+#endif
+}
+
+static inline uint32_t bits_ctz64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (uint32_t)i;
+#else
+    return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+// Index of the highest set bit, `x` must be non-zero
+static inline uint32_t bits_highest32(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (uint32_t)i;
+#else
+    return 31 - (uint32_t)__builtin_clz(x);
+#endif
+}
+
+static inline uint32_t bits_highest64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return (uint32_t)i;
+#else
+    return 63 - (uint32_t)__builtin_clzll(x);
+#endif
+}
+
+static inline uint32_t bits_popcount32(uint32_t x)
+{
+#if defined(_MSC_VER)
+    return (uint32_t)__popcnt(x);
+#else
+    return (uint32_t)__builtin_popcount(x);
+#endif
+}
+
+static inline uint32_t bits_popcount64(uint64_t x)
+{
+#if defined(_MSC_VER)
+    return (uint32_t)__popcnt64(x);
+#else
+    return (uint32_t)__builtin_popcountll(x);
+#endif
+}
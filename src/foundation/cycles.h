@@ -0,0 +1,22 @@
+#pragma once
+#include "foundation/basic.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__i386__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define CYCLES_HAS_TSC
+#endif
+
+// Time stamp counter, which ticks at a constant rate rather than at the current core clock.
+// Always 0 on targets without one.
+static inline uint64_t cycles_now(void)
+{
+#if defined(CYCLES_HAS_TSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,273 @@
+#pragma once
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/bits.h"
+#include "foundation/instrument.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+//
+// Open addressing hash table with a byte of metadata per slot, in the style of SwissTable
+//
+// Every slot has a control byte that is either empty, deleted or the low 7 bits of its key (h2).
+// The rest of the key (h1) picks the group of 16 slots to start probing at. A lookup compares the
+// control bytes of a whole group against h2 at once and only touches the slots that match, so
+// misses and long clusters rarely read a key at all. Keys and values are stored together so a hit
+// touches a single cache line. The capacity is a power of two and the table grows once it is 7/8
+// full, deleted slots included.
+//
+// Keys are used as hashes as is, any 64 bit value is a valid key.
+//
+
+#define FLAT_HASH_GROUP 16
+#define FLAT_HASH_EMPTY ((uint8_t)0x80)
+#define FLAT_HASH_DELETED ((uint8_t)0xfe)
+
+typedef struct Flat_Hash_Slot {
+    uint64_t key;
+    uint64_t value;
+} Flat_Hash_Slot;
+
+typedef struct Flat_Hash {
+    uint64_t capacity;
+    uint64_t size;
+    // Inserts left until the table has to grow
+    uint64_t growth_left;
+    // `capacity` control bytes followed by a copy of the first group, so a group can be loaded
+    // at any slot without wrapping
+    uint8_t *ctrl;
+    Flat_Hash_Slot *slots;
+} Flat_Hash;
+
+static inline bool flat_hash_has(const Flat_Hash *hash, uint64_t key);
+
+static inline uint64_t flat_hash_get(const Flat_Hash *hash, uint64_t key);
+
+static inline uint64_t flat_hash_get_default(const Flat_Hash *hash, uint64_t key, uint64_t def);
+
+static inline void flat_hash_update(Flat_Hash *hash, uint64_t key, uint64_t value);
+
+static inline uint64_t *flat_hash_add_reference(Flat_Hash *hash, uint64_t key, Allocator *a);
+
+static inline void flat_hash_add(Flat_Hash *hash, uint64_t key, uint64_t value, Allocator *a);
+
+static inline uint64_t flat_hash_remove(Flat_Hash *hash, uint64_t key);
+
+static inline void flat_hash_clear(Flat_Hash *hash);
+
+static inline void flat_hash_free(Flat_Hash *hash, Allocator *a);
+
+static inline uint8_t flat_hash__h2(uint64_t key)
+{
+    return (uint8_t)(key & 0x7f);
+}
+
+static inline uint64_t flat_hash__h1(uint64_t key)
+{
+    return key >> 7;
+}
+
+// Bit i is set if control byte i of the group at `ctrl` equals `c`
+static inline uint32_t flat_hash__match(const uint8_t *ctrl, uint8_t c)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < FLAT_HASH_GROUP; ++i)
+        mask |= (uint32_t)(ctrl[i] == c) << i;
+    return mask;
+#endif
+}
+
+// Bit i is set if slot i of the group at `ctrl` is empty or deleted, both have the top bit set
+static inline uint32_t flat_hash__match_free(const uint8_t *ctrl)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < FLAT_HASH_GROUP; ++i)
+        mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+static inline void flat_hash__set_ctrl(Flat_Hash *hash, uint64_t i, uint8_t c)
+{
+    hash->ctrl[i] = c;
+    if (i < FLAT_HASH_GROUP)
+        hash->ctrl[hash->capacity + i] = c;
+}
+
+static inline uint64_t flat_hash__ctrl_bytes(uint64_t capacity)
+{
+    // The capacity is a multiple of the group size, so the slots that follow stay aligned
+    return capacity + FLAT_HASH_GROUP;
+}
+
+static inline uint64_t flat_hash__alloc_size(uint64_t capacity)
+{
+    return capacity ? flat_hash__ctrl_bytes(capacity) + capacity * sizeof(Flat_Hash_Slot) : 0;
+}
+
+static inline uint64_t flat_hash__max_load(uint64_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+// Groups are probed triangularly, which visits every group once when the number of groups is a
+// power of two
+static inline uint64_t flat_hash__index(const Flat_Hash *hash, uint64_t key)
+{
+    if (!hash->capacity) {
+        // A lookup in an empty table still counts, as one that probed nothing
+        INSTRUMENT_HISTOGRAM(INSTRUMENT_FLAT_HASH_PROBE, 0);
+        return UINT64_MAX;
+    }
+
+    const uint64_t mask = hash->capacity - 1;
+    const uint8_t h2 = flat_hash__h2(key);
+    uint64_t pos = flat_hash__h1(key) & mask;
+    uint64_t step = 0;
+    uint64_t probes = 0;
+    while (true) {
+        const uint8_t *group = hash->ctrl + pos;
+        uint32_t match = flat_hash__match(group, h2);
+        ++probes;
+        while (match) {
+            uint64_t i = (pos + bits_ctz32(match)) & mask;
+            if (hash->slots[i].key == key) {
+                INSTRUMENT_HISTOGRAM(INSTRUMENT_FLAT_HASH_PROBE, probes);
+                return i;
+            }
+            match &= match - 1;
+        }
+        if (flat_hash__match(group, FLAT_HASH_EMPTY)) {
+            INSTRUMENT_HISTOGRAM(INSTRUMENT_FLAT_HASH_PROBE, probes);
+            return UINT64_MAX;
+        }
+        step += FLAT_HASH_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+static inline uint64_t flat_hash__free_index(const Flat_Hash *hash, uint64_t key)
+{
+    const uint64_t mask = hash->capacity - 1;
+    uint64_t pos = flat_hash__h1(key) & mask;
+    uint64_t step = 0;
+    while (true) {
+        uint32_t available = flat_hash__match_free(hash->ctrl + pos);
+        if (available)
+            return (pos + bits_ctz32(available)) & mask;
+        step += FLAT_HASH_GROUP;
+        pos = (pos + step) & mask;
+    }
+}
+
+static inline void flat_hash__resize(Flat_Hash *hash, uint64_t new_capacity, Allocator *a)
+{
+    Flat_Hash new_hash = { .capacity = new_capacity };
+    new_hash.ctrl = c_alloc(a, flat_hash__alloc_size(new_capacity));
+    new_hash.slots = (Flat_Hash_Slot *)(new_hash.ctrl + flat_hash__ctrl_bytes(new_capacity));
+    flat_hash_clear(&new_hash);
+
+    for (uint64_t i = 0; i < hash->capacity; ++i) {
+        if (hash->ctrl[i] & 0x80)
+            continue;
+        const Flat_Hash_Slot *slot = &hash->slots[i];
+        uint64_t j = flat_hash__free_index(&new_hash, slot->key);
+        flat_hash__set_ctrl(&new_hash, j, flat_hash__h2(slot->key));
+        new_hash.slots[j] = *slot;
+    }
+    new_hash.size = hash->size;
+    new_hash.growth_left -= hash->size;
+
+    flat_hash_free(hash, a);
+    *hash = new_hash;
+}
+
+static inline bool flat_hash_has(const Flat_Hash *hash, uint64_t key)
+{
+    return flat_hash__index(hash, key) != UINT64_MAX;
+}
+
+static inline uint64_t flat_hash_get(const Flat_Hash *hash, uint64_t key)
+{
+    const uint64_t i = flat_hash__index(hash, key);
+    return i != UINT64_MAX ? hash->slots[i].value : 0;
+}
+
+static inline uint64_t flat_hash_get_default(const Flat_Hash *hash, uint64_t key, uint64_t def)
+{
+    const uint64_t i = flat_hash__index(hash, key);
+    return i != UINT64_MAX ? hash->slots[i].value : def;
+}
+
+static inline void flat_hash_update(Flat_Hash *hash, uint64_t key, uint64_t value)
+{
+    const uint64_t i = flat_hash__index(hash, key);
+    if (i != UINT64_MAX)
+        hash->slots[i].value = value;
+}
+
+static inline uint64_t *flat_hash_add_reference(Flat_Hash *hash, uint64_t key, Allocator *a)
+{
+    uint64_t i = flat_hash__index(hash, key);
+    if (i != UINT64_MAX)
+        return &hash->slots[i].value;
+
+    if (hash->growth_left == 0) {
+        // Mostly deleted slots are cleaned up at the same size, otherwise the table doubles
+        uint64_t new_capacity = FLAT_HASH_GROUP;
+        if (hash->capacity)
+            new_capacity = hash->size * 2 >= flat_hash__max_load(hash->capacity) ? hash->capacity * 2 : hash->capacity;
+        flat_hash__resize(hash, new_capacity, a);
+    }
+
+    i = flat_hash__free_index(hash, key);
+    // Reusing a deleted slot doesn't use up an empty one
+    if (hash->ctrl[i] == FLAT_HASH_EMPTY)
+        hash->growth_left--;
+    flat_hash__set_ctrl(hash, i, flat_hash__h2(key));
+    hash->slots[i] = (Flat_Hash_Slot) { .key = key };
+    hash->size++;
+    return &hash->slots[i].value;
+}
+
+static inline void flat_hash_add(Flat_Hash *hash, uint64_t key, uint64_t value, Allocator *a)
+{
+    *flat_hash_add_reference(hash, key, a) = value;
+}
+
+static inline uint64_t flat_hash_remove(Flat_Hash *hash, uint64_t key)
+{
+    const uint64_t i = flat_hash__index(hash, key);
+    if (i == UINT64_MAX)
+        return 0;
+
+    flat_hash__set_ctrl(hash, i, FLAT_HASH_DELETED);
+    hash->size--;
+    return hash->slots[i].value;
+}
+
+static inline void flat_hash_clear(Flat_Hash *hash)
+{
+    if (!hash->capacity)
+        return;
+    memset(hash->ctrl, FLAT_HASH_EMPTY, flat_hash__ctrl_bytes(hash->capacity));
+    hash->size = 0;
+    hash->growth_left = flat_hash__max_load(hash->capacity);
+}
+
+static inline void flat_hash_free(Flat_Hash *hash, Allocator *a)
+{
+    c_free(a, hash->ctrl, flat_hash__alloc_size(hash->capacity));
+    *hash = (Flat_Hash) { 0 };
+}
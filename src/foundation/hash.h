@@ -1,6 +1,7 @@
 #pragma once
 #include "foundation/basic.h"
 #include "foundation/allocator.h"
+#include "foundation/instrument.h"
 
 #include <string.h>
 
@@ -52,13 +53,14 @@ static inline uint32_t hash__index(const Hash *hash, uint64_t key)
     uint32_t distance = 0;
     while (hash->keys[i] != key)
     {
-        if (distance > max_distance)
-            return UINT32_MAX;
-        if (hash->keys[i] == HASH_UNUSED)
+        if (distance > max_distance || hash->keys[i] == HASH_UNUSED) {
+            INSTRUMENT_HISTOGRAM(INSTRUMENT_HASH_PROBE, distance + 1);
             return UINT32_MAX;
+        }
         i = hash__next_index(hash, i);
         ++distance;
     }
+    INSTRUMENT_HISTOGRAM(INSTRUMENT_HASH_PROBE, distance + 1);
     return i;
 }
 
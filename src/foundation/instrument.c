@@ -0,0 +1,108 @@
+#include "instrument.h"
+
+#if defined(LEXER_INSTRUMENT)
+
+#include "foundation/atomic.h"
+
+#if defined(_MSC_VER)
+__declspec(thread) Instrument_Counters *instrument__local;
+#else
+_Thread_local Instrument_Counters *instrument__local;
+#endif
+
+// Head of the list of every thread's counters, pushed to with a CAS so threads can register at any time
+static volatile uint64_t instrument__threads;
+
+static const char *instrument__proc_names[INSTRUMENT_NUM_PROCS] = {
+    "lexer_match",
+    "read_identifier",
+    "read_number",
+    "read_string",
+    "read_comment",
+};
+
+static const char *instrument__counter_names[INSTRUMENT_NUM_COUNTERS] = {
+    "atom_add hits",
+    "atom_add misses",
+    "token array regrowths",
+};
+
+static const char *instrument__histogram_names[INSTRUMENT_NUM_HISTOGRAMS] = {
+    "hash__index probe length (slots)",
+    "flat_hash__index probe length (groups)",
+};
+
+Instrument_Counters *instrument__register_thread(void)
+{
+    Instrument_Counters *c = calloc(1, sizeof(*c));
+
+    uint64_t head;
+    do {
+        head = atomic_load_u64(&instrument__threads);
+        c->next = (Instrument_Counters *)head;
+    } while (!atomic_cas_u64(&instrument__threads, head, (uint64_t)c));
+
+    instrument__local = c;
+    return c;
+}
+
+void instrument_print_report(Instrument_Token_Name_Proc *name)
+{
+    Instrument_Counters total = { 0 };
+    uint32_t num_threads = 0;
+
+    // Threads that are still running may be counting while this reads
+    for (Instrument_Counters *c = (Instrument_Counters *)atomic_load_u64(&instrument__threads); c; c = c->next) {
+        for (uint32_t i = 0; i < INSTRUMENT_NUM_PROCS; ++i) {
+            total.proc_cycles[i] += c->proc_cycles[i];
+            total.proc_calls[i] += c->proc_calls[i];
+        }
+        for (uint32_t i = 0; i < INSTRUMENT_NUM_COUNTERS; ++i)
+            total.counters[i] += c->counters[i];
+        for (uint32_t h = 0; h < INSTRUMENT_NUM_HISTOGRAMS; ++h) {
+            for (uint32_t i = 0; i < INSTRUMENT_HISTOGRAM_BUCKETS; ++i)
+                total.histograms[h][i] += c->histograms[h][i];
+        }
+        for (uint32_t i = 0; i < INSTRUMENT_MAX_TOKEN_TYPES; ++i)
+            total.token_types[i] += c->token_types[i];
+        ++num_threads;
+    }
+
+    printf("\n\n== Instrumentation (%u threads) ==\n", num_threads);
+
+    uint64_t all_cycles = 0;
+    for (uint32_t i = 0; i < INSTRUMENT_NUM_PROCS; ++i)
+        all_cycles += total.proc_cycles[i];
+    printf("\nCycles per function:\n");
+    for (uint32_t i = 0; i < INSTRUMENT_NUM_PROCS; ++i) {
+        uint64_t calls = total.proc_calls[i];
+        printf("  %-16s %12zu calls %14zu cycles %8.1f per call %5.1f%%\n", instrument__proc_names[i], calls,
+            total.proc_cycles[i], calls ? (double)total.proc_cycles[i] / calls : 0.0,
+            all_cycles ? 100.0 * total.proc_cycles[i] / all_cycles : 0.0);
+    }
+
+    printf("\nTokens per type:\n");
+    for (uint32_t i = 0; i < INSTRUMENT_MAX_TOKEN_TYPES; ++i) {
+        if (total.token_types[i])
+            printf("  %-16s %12zu\n", name(i), total.token_types[i]);
+    }
+
+    printf("\nCounters:\n");
+    for (uint32_t i = 0; i < INSTRUMENT_NUM_COUNTERS; ++i)
+        printf("  %-24s %12zu\n", instrument__counter_names[i], total.counters[i]);
+
+    for (uint32_t h = 0; h < INSTRUMENT_NUM_HISTOGRAMS; ++h) {
+        uint64_t samples = 0;
+        for (uint32_t i = 0; i < INSTRUMENT_HISTOGRAM_BUCKETS; ++i)
+            samples += total.histograms[h][i];
+        printf("\n%s, %zu lookups:\n", instrument__histogram_names[h], samples);
+        for (uint32_t i = 0; i < INSTRUMENT_HISTOGRAM_BUCKETS; ++i) {
+            if (!total.histograms[h][i])
+                continue;
+            printf("  %2u%s %12zu %5.1f%%\n", i, i == INSTRUMENT_HISTOGRAM_BUCKETS - 1 ? "+" : " ",
+                total.histograms[h][i], 100.0 * total.histograms[h][i] / samples);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+#include "foundation/basic.h"
+
+//
+// Hot path instrumentation, only compiled in when LEXER_INSTRUMENT is defined
+// (`premake5 --instrument`). Without it every macro below expands to nothing, or to the plain call
+// for INSTRUMENT_CALL, so release builds carry no trace of it.
+//
+// Each thread counts into its own block, so lexer threads don't share cache lines. Blocks are kept
+// after their thread exits and summed up by `instrument_print_report`.
+//
+
+// Functions timed with INSTRUMENT_CALL
+typedef enum Instrument_Proc {
+    // Running the DFA to find the longest match
+    INSTRUMENT_MATCH,
+    INSTRUMENT_READ_IDENTIFIER,
+    INSTRUMENT_READ_NUMBER,
+    INSTRUMENT_READ_STRING,
+    INSTRUMENT_READ_COMMENT,
+    INSTRUMENT_NUM_PROCS,
+} Instrument_Proc;
+
+typedef enum Instrument_Counter {
+    INSTRUMENT_ATOM_HIT,
+    INSTRUMENT_ATOM_MISS,
+    INSTRUMENT_TOKEN_ARRAY_GROW,
+    INSTRUMENT_NUM_COUNTERS,
+} Instrument_Counter;
+
+// Values past the last bucket are counted in it
+typedef enum Instrument_Histogram {
+    // Slots probed by `hash__index`
+    INSTRUMENT_HASH_PROBE,
+    // Groups probed by `flat_hash__index`
+    INSTRUMENT_FLAT_HASH_PROBE,
+    INSTRUMENT_NUM_HISTOGRAMS,
+} Instrument_Histogram;
+
+#define INSTRUMENT_HISTOGRAM_BUCKETS 16
+#define INSTRUMENT_MAX_TOKEN_TYPES 1024
+
+typedef const char *Instrument_Token_Name_Proc(uint32_t type);
+
+#if defined(LEXER_INSTRUMENT)
+
+#include "foundation/cycles.h"
+
+typedef struct Instrument_Counters {
+    uint64_t proc_cycles[INSTRUMENT_NUM_PROCS];
+    uint64_t proc_calls[INSTRUMENT_NUM_PROCS];
+    uint64_t counters[INSTRUMENT_NUM_COUNTERS];
+    uint64_t histograms[INSTRUMENT_NUM_HISTOGRAMS][INSTRUMENT_HISTOGRAM_BUCKETS];
+    uint64_t token_types[INSTRUMENT_MAX_TOKEN_TYPES];
+    struct Instrument_Counters *next;
+} Instrument_Counters;
+
+// Returns the counters of the calling thread, registering them on first use
+Instrument_Counters *instrument__register_thread(void);
+
+#if defined(_MSC_VER)
+extern __declspec(thread) Instrument_Counters *instrument__local;
+#else
+extern _Thread_local Instrument_Counters *instrument__local;
+#endif
+
+static inline Instrument_Counters *instrument__counters(void)
+{
+    Instrument_Counters *c = instrument__local;
+    return c ? c : instrument__register_thread();
+}
+
+static inline void instrument__histogram(Instrument_Histogram h, uint64_t value)
+{
+    uint64_t bucket = value < INSTRUMENT_HISTOGRAM_BUCKETS ? value : INSTRUMENT_HISTOGRAM_BUCKETS - 1;
+    instrument__counters()->histograms[h][bucket]++;
+}
+
+static inline void instrument__token(uint32_t type)
+{
+    if (type < INSTRUMENT_MAX_TOKEN_TYPES)
+        instrument__counters()->token_types[type]++;
+}
+
+// Print the sum of all threads' counters to stdout, `name` turns a token type into text
+void instrument_print_report(Instrument_Token_Name_Proc *name);
+
+#define INSTRUMENT_CALL(proc, call) do { \
+        uint64_t instrument__start = cycles_now(); \
+        call; \
+        Instrument_Counters *instrument__c = instrument__counters(); \
+        instrument__c->proc_cycles[proc] += cycles_now() - instrument__start; \
+        instrument__c->proc_calls[proc]++; \
+    } while (0)
+
+#define INSTRUMENT_COUNT(counter) (instrument__counters()->counters[counter]++)
+#define INSTRUMENT_HISTOGRAM(h, value) instrument__histogram(h, value)
+#define INSTRUMENT_TOKEN(type) instrument__token((uint32_t)(type))
+#define INSTRUMENT_REPORT(name) instrument_print_report(name)
+
+#else
+
+#define INSTRUMENT_CALL(proc, call) call
+#define INSTRUMENT_COUNT(counter) ((void)0)
+#define INSTRUMENT_HISTOGRAM(h, value) ((void)(value))
+#define INSTRUMENT_TOKEN(type) ((void)0)
+#define INSTRUMENT_REPORT(name) ((void)0)
+
+#endif
@@ -1,7 +1,24 @@
 #include "os_helper.h"
 #include "foundation/allocator.h"
 
+#include <string.h>
+
+#if defined(OS_WINDOWS)
 #include <windows.h>
+#include <psapi.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 void *os_read_entire_file(const char *path, uint64_t *sz, Allocator *a)
 {
@@ -16,16 +33,106 @@ void *os_read_entire_file(const char *path, uint64_t *sz, Allocator *a)
 
     void *data = c_alloc(a, size);
     uint64_t actual_size = fread(data, 1, size, f);
+    fclose(f);
     if (actual_size != size) {
         printf("Failed to read entire file!\n");
         c_free(a, data, size);
         return 0;
     }
     *sz = size;
-    fclose(f);
     return data;
 }
 
+// Returned for empty files, which can't be mapped
+static const uint8_t os__empty_file[1];
+
+#if defined(OS_WINDOWS)
+
+const void *os_map_file(const char *path, uint64_t *sz)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 
+        FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return 0;
+    }
+
+    *sz = (uint64_t)size.QuadPart;
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return os__empty_file;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    CloseHandle(file);
+    if (mapping == 0)
+        return 0;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == 0)
+        return 0;
+
+    WIN32_MEMORY_RANGE_ENTRY range = { data, (SIZE_T)size.QuadPart };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    return data;
+}
+
+void os_unmap_file(const void *data, uint64_t size)
+{
+    if (data && data != os__empty_file)
+        UnmapViewOfFile(data);
+}
+
+void os_list_files(const char *dir, Os_List_Files_Proc *proc, void *user_data)
+{
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+
+    WIN32_FIND_DATAA find;
+    HANDLE handle = FindFirstFileA(pattern, &find);
+    if (handle == INVALID_HANDLE_VALUE)
+        return;
+
+    do {
+        if (strcmp(find.cFileName, ".") == 0 || strcmp(find.cFileName, "..") == 0)
+            continue;
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "%s\\%s", dir, find.cFileName);
+        if (find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            os_list_files(path, proc, user_data);
+        else
+            proc(path, user_data);
+    } while (FindNextFileA(handle, &find));
+
+    FindClose(handle);
+}
+
+bool os_is_directory(const char *path)
+{
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool os_create_directory(const char *path)
+{
+    return CreateDirectoryA(path, 0) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool os_replace_file(const char *from, const char *to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+void os_set_binary_mode(FILE *f)
+{
+    _setmode(_fileno(f), _O_BINARY);
+}
+
 uint64_t os_time_now()
 {
     uint64_t now;
@@ -50,7 +157,7 @@ void *os_reserve(uint64_t size)
     return mem;
 }
 
-void os_release(void *mem)
+void os_release(void *mem, uint64_t size)
 {
     VirtualFree(mem, 0, MEM_RELEASE);
 }
@@ -64,3 +171,251 @@ void os_decommit(void *mem, uint64_t size)
 {
     VirtualFree(mem, size, MEM_DECOMMIT);
 }
+
+typedef struct Os__Thread_Start {
+    Os_Thread_Proc *proc;
+    void *user_data;
+} Os__Thread_Start;
+
+static DWORD WINAPI os__thread_entry(void *param)
+{
+    Os__Thread_Start start = *(Os__Thread_Start *)param;
+    free(param);
+    start.proc(start.user_data);
+    return 0;
+}
+
+uint64_t os_thread_create(Os_Thread_Proc *proc, void *user_data)
+{
+    Os__Thread_Start *start = malloc(sizeof(*start));
+    *start = (Os__Thread_Start) { proc, user_data };
+    HANDLE thread = CreateThread(0, 0, os__thread_entry, start, 0, 0);
+    if (thread == 0)
+        free(start);
+    return (uint64_t)thread;
+}
+
+void os_thread_join(uint64_t thread)
+{
+    WaitForSingleObject((HANDLE)thread, INFINITE);
+    CloseHandle((HANDLE)thread);
+}
+
+uint32_t os_num_cores()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+uint64_t os_peak_memory()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (uint64_t)counters.PeakWorkingSetSize;
+}
+
+void os_mutex_init(Os_Mutex *mutex)
+{
+    InitializeSRWLock((SRWLOCK *)mutex);
+}
+
+void os_mutex_destroy(Os_Mutex *mutex)
+{
+}
+
+void os_mutex_lock(Os_Mutex *mutex)
+{
+    AcquireSRWLockExclusive((SRWLOCK *)mutex);
+}
+
+void os_mutex_unlock(Os_Mutex *mutex)
+{
+    ReleaseSRWLockExclusive((SRWLOCK *)mutex);
+}
+
+#else
+
+const void *os_map_file(const char *path, uint64_t *sz)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    *sz = (uint64_t)st.st_size;
+    if (st.st_size == 0) {
+        close(fd);
+        return os__empty_file;
+    }
+
+    void *data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+
+    // Start reading the file in ahead of the lexer instead of faulting it in a page at a time
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+    return data;
+}
+
+void os_unmap_file(const void *data, uint64_t size)
+{
+    if (data && data != os__empty_file)
+        munmap((void *)data, (size_t)size);
+}
+
+void os_list_files(const char *dir, Os_List_Files_Proc *proc, void *user_data)
+{
+    DIR *d = opendir(dir);
+    if (d == 0)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != 0) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            os_list_files(path, proc, user_data);
+        else if (S_ISREG(st.st_mode))
+            proc(path, user_data);
+    }
+
+    closedir(d);
+}
+
+bool os_is_directory(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool os_create_directory(const char *path)
+{
+    return mkdir(path, 0777) == 0 || (errno == EEXIST && os_is_directory(path));
+}
+
+bool os_replace_file(const char *from, const char *to)
+{
+    return rename(from, to) == 0;
+}
+
+void os_set_binary_mode(FILE *f)
+{
+    // No newline translation to turn off
+}
+
+uint64_t os_time_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+double os_time_delta(uint64_t to, uint64_t from)
+{
+    return (to - from) * 1e-9;
+}
+
+void *os_reserve(uint64_t size)
+{
+    void *mem = mmap(0, (size_t)size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem != MAP_FAILED ? mem : 0;
+}
+
+void os_release(void *mem, uint64_t size)
+{
+    munmap(mem, (size_t)size);
+}
+
+void os_commit(void *mem, uint64_t size)
+{
+    mprotect(mem, (size_t)size, PROT_READ | PROT_WRITE);
+}
+
+void os_decommit(void *mem, uint64_t size)
+{
+    madvise(mem, (size_t)size, MADV_DONTNEED);
+    mprotect(mem, (size_t)size, PROT_NONE);
+}
+
+typedef struct Os__Thread_Start {
+    Os_Thread_Proc *proc;
+    void *user_data;
+} Os__Thread_Start;
+
+static void *os__thread_entry(void *param)
+{
+    Os__Thread_Start start = *(Os__Thread_Start *)param;
+    free(param);
+    start.proc(start.user_data);
+    return 0;
+}
+
+uint64_t os_thread_create(Os_Thread_Proc *proc, void *user_data)
+{
+    Os__Thread_Start *start = malloc(sizeof(*start));
+    *start = (Os__Thread_Start) { proc, user_data };
+    pthread_t thread;
+    if (pthread_create(&thread, 0, os__thread_entry, start) != 0) {
+        free(start);
+        return 0;
+    }
+    return (uint64_t)thread;
+}
+
+void os_thread_join(uint64_t thread)
+{
+    pthread_join((pthread_t)thread, 0);
+}
+
+uint32_t os_num_cores()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+}
+
+uint64_t os_peak_memory()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // Reported in kilobytes
+    return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+_Static_assert(sizeof(pthread_mutex_t) <= sizeof(Os_Mutex), "Os_Mutex is too small");
+
+void os_mutex_init(Os_Mutex *mutex)
+{
+    pthread_mutex_init((pthread_mutex_t *)mutex, 0);
+}
+
+void os_mutex_destroy(Os_Mutex *mutex)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+}
+
+void os_mutex_lock(Os_Mutex *mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t *)mutex);
+}
+
+void os_mutex_unlock(Os_Mutex *mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+#endif
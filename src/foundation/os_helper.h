@@ -5,10 +5,48 @@ struct Allocator;
 
 void *os_read_entire_file(const char *path, uint64_t *sz, struct Allocator *a);
 
+// Map the file at `path` read-only into memory, hinted for a single sequential pass.
+// The data is read straight out of the page cache without being copied.
+// Returns 0 if the file can't be opened; release with `os_unmap_file`.
+const void *os_map_file(const char *path, uint64_t *sz);
+void os_unmap_file(const void *data, uint64_t size);
+
+typedef void Os_List_Files_Proc(const char *path, void *user_data);
+
+// Call `proc` for every regular file below `dir`, recursing into subdirectories
+void os_list_files(const char *dir, Os_List_Files_Proc *proc, void *user_data);
+bool os_is_directory(const char *path);
+// Returns true if the directory exists afterwards, parent directories must exist
+bool os_create_directory(const char *path);
+// Rename `from` to `to`, replacing `to` if it exists. Readers of `to` see either file, never a mix.
+bool os_replace_file(const char *from, const char *to);
+// Stop `f` from translating newlines, for writing binary data to stdout
+void os_set_binary_mode(FILE *f);
+
 uint64_t os_time_now();
 double os_time_delta(uint64_t to, uint64_t from);
 
 void *os_reserve(uint64_t size);
-void os_release(void *mem);
+void os_release(void *mem, uint64_t size);
 void os_commit(void *mem, uint64_t size);
 void os_decommit(void *mem, uint64_t size);
+
+typedef void Os_Thread_Proc(void *user_data);
+
+// Returns an opaque handle to the started thread, 0 on failure
+uint64_t os_thread_create(Os_Thread_Proc *proc, void *user_data);
+void os_thread_join(uint64_t thread);
+uint32_t os_num_cores();
+
+// Largest resident memory of the process so far in bytes, 0 if unknown
+uint64_t os_peak_memory();
+
+// Opaque storage large enough for the native mutex on every platform
+typedef struct Os_Mutex {
+    uint64_t opaque[8];
+} Os_Mutex;
+
+void os_mutex_init(Os_Mutex *mutex);
+void os_mutex_destroy(Os_Mutex *mutex);
+void os_mutex_lock(Os_Mutex *mutex);
+void os_mutex_unlock(Os_Mutex *mutex);
@@ -0,0 +1,21 @@
+#pragma once
+#include "foundation/basic.h"
+
+//
+// Number decoding straight from source bytes, without copying or locale lookups
+//
+// The integer parsers expect `str` to hold only digits of their base, which the lexer has already
+// checked. They return false on overflow and then store UINT64_MAX, the same value `strtoull` gives.
+// An empty string decodes to 0.
+//
+bool parse_u64_decimal(const uint8_t *str, uint64_t len, uint64_t *value);
+bool parse_u64_hex(const uint8_t *str, uint64_t len, uint64_t *value);
+bool parse_u64_binary(const uint8_t *str, uint64_t len, uint64_t *value);
+
+//
+// Decode the longest prefix of `str` of the form digits [. digits] [e|E [+|-] digits] into the
+// nearest double, rounding ties to even like `strtod`. Returns the number of bytes used.
+// Numbers with up to 19 significant digits are decoded with the Eisel-Lemire algorithm, longer
+// ones only fall back to `strtod` when the first 19 digits don't settle the rounding.
+//
+uint64_t parse_f64(const uint8_t *str, uint64_t len, double *value);
@@ -1,301 +1,1070 @@
 #include "lexer.h"
+#include "char_class.h"
+#include "line_index.h"
+#include "source_file.h"
+#include "token_cache.h"
+#include "token_pack.h"
+#include "token_stream.h"
+#include "utf8.h"
 #include "foundation/atom.h"
 #include "foundation/array.h"
+#include "foundation/atomic.h"
 #include "foundation/allocator.h"
-#include "foundation/atom.h"
+#include "foundation/instrument.h"
 #include "foundation/os_helper.h"
-#include <ctype.h>
+#include "foundation/parse_number.h"
+#include "lexer_dfa.h"
+
+// What a streaming step that ran into the end of the window was in the middle of, the next step
+// continues it after the refill
+typedef enum Lexer_Resume {
+    LEXER_RESUME_NONE,
+    LEXER_RESUME_LINE_COMMENT,
+    LEXER_RESUME_BLOCK_COMMENT,
+    // Rest of an overlong string or match that's skipped after its TOKEN_ERROR
+    LEXER_RESUME_STRING,
+    LEXER_RESUME_MATCH,
+} Lexer_Resume;
 
 typedef struct Lexer {
-    uint8_t *data;
+    const uint8_t *data;
     uint64_t size;
     uint64_t cursor;
+    // Line tracking is skipped when the output only needs byte offsets
+    bool track_lines;
+    // Set while streaming and more input follows `size`, a token touching the end is then incomplete
+    bool more_input;
+    bool incomplete;
+    Lexer_Resume resume;
+    // The window ended on the `*` of a possible `*/`, or on a backslash that escapes the next byte
+    bool resume_escape;
+    uint8_t resume_quote;
+    uint32_t resume_state;
     int current_line;
-    int current_char;
+    // Offset of the first byte on `current_line`, columns are derived from it
+    uint64_t line_start;
+    // Start of the token being read
+    uint64_t token_start;
+    int token_line;
+    int token_char;
+    // Output, either an array of Token, a compact Token_Stream or a Token_Pack
     Token **tokens;
+    Token_Stream *stream;
+    Token_Pack *pack;
+    // Start offset of every emitted token, only recorded for parallel chunks
+    uint64_t **token_starts;
+    // Identifiers and strings get a span of `data` instead of being interned into `atoms`
+    bool spans;
     Atom_Table *atoms;
     Allocator *allocator;
-    uint8_t scratch_buf[512];
 } Lexer;
 
-static inline Token *make_token(Token_Type type, Lexer *lexer)
+static inline int current_char(Lexer *l)
 {
-    Token token = { 
-        .type = type, 
-        .l0 = lexer->current_line, 
-        .c0 = lexer->current_char 
-    };
-    array_push(*lexer->tokens, token, lexer->allocator);
-    return &(*lexer->tokens)[array_size(*lexer->tokens) - 1];
+    return (int)(l->cursor - l->line_start) + 1;
 }
 
-static char peek_next_char(Lexer *l)
+static inline void begin_token(Lexer *l)
 {
-    if (l->cursor >= l->size)
-        return -1;
-    return l->data[l->cursor];
+    l->token_start = l->cursor;
+    if (l->track_lines) {
+        l->token_line = l->current_line;
+        l->token_char = current_char(l);
+    }
 }
 
-static char peek_char(Lexer *l, int lookahead)
+static inline void emit_token(Lexer *l, Token_Type type, Token_Payload payload)
 {
-    int64_t idx = (int64_t)l->cursor + lookahead;
-    if (idx < 0 || idx >= (int64_t)l->size)
-        return -1;
-    return l->data[idx];
+    INSTRUMENT_TOKEN(type);
+
+    if (l->token_starts)
+        array_push(*l->token_starts, l->token_start, l->allocator);
+
+    if (l->stream) {
+        if (array_size(l->stream->types) == array_capacity(l->stream->types))
+            INSTRUMENT_COUNT(INSTRUMENT_TOKEN_ARRAY_GROW);
+        token_stream_push(l->stream, type, (uint32_t)l->token_start, 
+            (uint32_t)(l->cursor - l->token_start), payload, l->allocator);
+        return;
+    }
+
+    if (l->pack) {
+        token_pack_push(l->pack, type, (uint32_t)l->token_start, (uint32_t)(l->cursor - l->token_start), 
+            payload, l->allocator);
+        return;
+    }
+
+    Token token = { 
+        .type = type, 
+        .l0 = l->token_line, 
+        .c0 = l->token_char,
+        .l1 = l->current_line,
+        .c1 = current_char(l),
+        // Payload bits are copied as is into the Token union
+        .int_value = payload.int_value,
+    };
+    if (type == TOKEN_STRING) {
+        // Positions start after the opening quote
+        token.c0++;
+    }
+    if (array_size(*l->tokens) == array_capacity(*l->tokens))
+        INSTRUMENT_COUNT(INSTRUMENT_TOKEN_ARRAY_GROW);
+    array_push(*l->tokens, token, l->allocator);
 }
 
-static void eat_char(Lexer *l)
+static inline void eat_char(Lexer *l)
 {
-    if (l->data[l->cursor] == '\n') {
+    if (l->track_lines && l->data[l->cursor] == '\n') {
         l->current_line++;
-        l->current_char = 0;
+        l->line_start = l->cursor + 1;
     }
     l->cursor++;
-    l->current_char++;
 }
 
-static void read_identifier(Lexer *l)
-{
-    Token *token = make_token(TOKEN_IDENTIFIER, l);
+//
+// Token bodies, the DFA hands them over once it has matched how they start
+//
 
-    uint32_t num_chars = 0;
-    char c = peek_next_char(l);
-    while (isalnum(c) || c == '_') {
-        l->scratch_buf[num_chars++] = c;
-        eat_char(l);
-        c = peek_next_char(l);
+// Keyword spelled `str`, or TOKEN_IDENTIFIER. The DFA finds keywords itself, this is only needed when
+// `read_identifier` cuts a match short.
+static Token_Type find_keyword(const uint8_t *str, uint64_t len)
+{
+    for (uint32_t i = 0; i < TOKEN_KEYWORD_LAST - TOKEN_KEYWORD_FIRST; ++i) {
+        if (strlen(keyword_strings[i]) == len && memcmp(keyword_strings[i], str, len) == 0)
+            return (Token_Type)(TOKEN_KEYWORD_FIRST + i);
     }
-    l->scratch_buf[num_chars] = 0;
+    return TOKEN_IDENTIFIER;
+}
 
-    // Lazy check for keywords
-    const uint32_t num_keywords = TOKEN_KEYWORD_LAST - TOKEN_KEYWORD_IF;
-    for (uint32_t i = 0; i < num_keywords; ++i) {
-        if (strcmp(l->scratch_buf, keyword_strings[i]) == 0) {
-            token->type = TOKEN_KEYWORD_IF + i;
-            break;
+// Sets the name of `payload` to the atom of [start, start + len), returns false if the atom table is full
+static inline bool lexer_intern(Lexer *l, uint64_t start, uint32_t len, Token_Payload *payload)
+{
+    Atom *atom = atom_add(l->atoms, (const char *)l->data + start, len);
+    if (atom == 0)
+        return false;
+    payload->name = atom->id;
+    return true;
+}
+
+static void read_identifier(Lexer *l)
+{
+    // The DFA matches any run of non-ASCII bytes as part of an identifier, only code points with the
+    // XID properties actually are. Pure ASCII matches are told apart with a single SIMD test.
+    if (scan_non_ascii(l->data, l->token_start, l->cursor, l->size) != l->cursor) {
+        uint64_t end = utf8_scan_identifier(l->data, l->token_start, l->cursor, l->size);
+        if (end == l->token_start) {
+            // Not an identifier character, skipped like whitespace
+            uint32_t cp;
+            uint32_t len = utf8_decode(l->data + end, l->size - end, &cp);
+            l->cursor = end + (len ? len : 1);
+            return;
+        }
+        l->cursor = end;
+        Token_Type keyword = find_keyword(l->data + l->token_start, end - l->token_start);
+        if (keyword != TOKEN_IDENTIFIER) {
+            emit_token(l, keyword, (Token_Payload) { 0 });
+            return;
         }
     }
 
-    if (token->type == TOKEN_IDENTIFIER) {
-        Atom *atom = atom_add(l->atoms, l->scratch_buf, num_chars);
-        token->name = atom;
+    uint32_t len = (uint32_t)(l->cursor - l->token_start);
+    Token_Payload payload = { 0 };
+    if (l->spans) {
+        payload.span = (Token_Span) { .offset = (uint32_t)l->token_start, .length = len };
+    } else if (!lexer_intern(l, l->token_start, len, &payload)) {
+        emit_token(l, TOKEN_ERROR, (Token_Payload) { 0 });
+        return;
     }
-
-    token->l1 = l->current_line;
-    token->c1 = l->current_char;
+    emit_token(l, TOKEN_IDENTIFIER, payload);
 }
 
-static void read_number(Lexer *l)
+// The DFA has matched the whole literal, `kind` tells which form it is
+static void read_number(Lexer *l, Lexer_Action kind)
 {
-    Token *token = make_token(TOKEN_NUMBER, l);
-    uint32_t num_chars = 0;
-    char c = peek_next_char(l);
+    const uint8_t *text = l->data + l->token_start;
+    uint64_t len = l->cursor - l->token_start;
+    Token_Payload payload = { 0 };
 
-    if (c == '0' && peek_char(l, 1) == 'x') {
-        // Parse hexadecimal
-        eat_char(l);
-        eat_char(l);
-        c = peek_next_char(l);
-        while (isxdigit(c)) {
-            l->scratch_buf[num_chars++] = c;
-            eat_char(l);
-            c = peek_next_char(l);
-        }
-        l->scratch_buf[num_chars] = 0;
-        token->int_value = strtoull(l->scratch_buf, NULL, 16);
-    }
-    else if (c == '0' && peek_char(l, 1) == 'b') {
-        // Parse binary
-        eat_char(l);
-        eat_char(l);
-        c = peek_next_char(l);
-        while (c == '0' || c == '1') {
-            l->scratch_buf[num_chars++] = c;
-            eat_char(l);
-            c = peek_next_char(l);
-        }
-        l->scratch_buf[num_chars] = 0;
-        token->int_value = strtoull(l->scratch_buf, NULL, 2);
-    }
-    else {
-        bool is_float = false;
-        while (isdigit(c) || c == '.') {
-            is_float |= (c == '.');
-            l->scratch_buf[num_chars++] = c;
-            eat_char(l);
-            c = peek_next_char(l);
-        }
-        l->scratch_buf[num_chars] = 0;
-        if (is_float)
-            token->float_value = strtod(l->scratch_buf, NULL);
-        else
-            token->int_value = strtoull(l->scratch_buf, NULL, 10);
-    }
+    if (kind == LEXER_ACTION_NUMBER_HEX)
+        parse_u64_hex(text + 2, len - 2, &payload.int_value);
+    else if (kind == LEXER_ACTION_NUMBER_BINARY)
+        parse_u64_binary(text + 2, len - 2, &payload.int_value);
+    else if (kind == LEXER_ACTION_NUMBER_FLOAT)
+        parse_f64(text, len, &payload.float_value);
+    else
+        parse_u64_decimal(text, len, &payload.int_value);
 
-    token->l1 = l->current_line;
-    token->c1 = l->current_char;
+    emit_token(l, TOKEN_NUMBER, payload);
 }
 
-static void read_comment(Lexer *l)
+static void read_line_comment(Lexer *l)
 {
-    eat_char(l);
-    char c = peek_next_char(l);
-    bool single_line = (c == '/');
-    bool multi_line  = (c == '*');
-    eat_char(l);
-
-    while ((c = peek_next_char(l)) >= 0) {
+    l->cursor = scan_line_end(l->data, l->cursor, l->size);
+    if (l->cursor < l->size)
         eat_char(l);
-        if (single_line && c == '\n')
-            break;
-        if (multi_line && c == '*' && peek_next_char(l) == '/') {
-            eat_char(l);
-            break;
-        }
+    else if (l->more_input)
+        l->resume = LEXER_RESUME_LINE_COMMENT;
+}
+
+static void read_block_comment(Lexer *l)
+{
+    uint64_t start = l->cursor;
+    l->cursor = scan_block_comment(l->data, l->cursor, l->size, &l->current_line, &l->line_start);
+    bool closed = l->cursor - start >= 2 && l->data[l->cursor - 2] == '*' && l->data[l->cursor - 1] == '/';
+    if (!closed && l->more_input) {
+        l->resume = LEXER_RESUME_BLOCK_COMMENT;
+        l->resume_escape = l->cursor > start && l->data[l->cursor - 1] == '*';
     }
 }
 
-static void read_string(Lexer *l)
+// Whether the byte after the string contents [start, end) is escaped, `escaped` tells if the one at
+// `start` is
+static bool string_escape_pending(const uint8_t *data, uint64_t start, uint64_t end, bool escaped)
 {
-    char end_symbol = peek_next_char(l);
-    eat_char(l);
+    uint64_t pos = end;
+    while (pos > start && data[pos - 1] == '\\')
+        --pos;
+    if (pos == start && escaped)
+        return end == start || ((end - start - 1) & 1);
+    return (end - pos) & 1;
+}
 
-    Token *token = make_token(TOKEN_STRING, l);
+// The cursor is right after the opening quote
+static void read_string(Lexer *l)
+{
+    uint64_t start = l->cursor;
+    bool non_ascii = false;
+    uint64_t end = scan_string(l->data, start, l->size, l->data[l->token_start], &l->current_line, &l->line_start,
+        &non_ascii);
+    // Step over the closing quote
+    l->cursor = end < l->size ? end + 1 : end;
 
-    char c;
-    uint32_t num_chars = 0;
-    while ((c = peek_next_char(l)) >= 0) {
-        eat_char(l);
-        if (c == end_symbol) {
-            // End parsing string when the end symbol is seen
-            // Ignore if it's an escape sequence (\' or \")
-            bool escape_sequence = peek_char(l, -2) == '\\' && peek_char(l, -3) != '\\';
-            if (!escape_sequence)
-                break;
-        }
-        l->scratch_buf[num_chars++] = c;
+    if (l->cursor >= l->size && l->more_input) {
+        l->incomplete = true;
+        return;
     }
 
-    Atom *atom = atom_add(l->atoms, l->scratch_buf, num_chars);
-    token->string_value = atom->str;
+    // Contents that aren't valid UTF-8 make the whole literal an error, ASCII ones need no decoding
+    if (non_ascii && !utf8_validate(l->data, start, end, l->size)) {
+        emit_token(l, TOKEN_ERROR, (Token_Payload) { 0 });
+        return;
+    }
 
-    token->l1 = l->current_line;
-    token->c1 = l->current_char;
+    // Intern the contents straight from the source, or only point at them. Contents that don't fit the
+    // atom table are an error too.
+    Token_Payload payload = { 0 };
+    if (l->spans) {
+        payload.span = (Token_Span) { .offset = (uint32_t)start, .length = (uint32_t)(end - start) };
+    } else if (!lexer_intern(l, start, (uint32_t)(end - start), &payload)) {
+        emit_token(l, TOKEN_ERROR, (Token_Payload) { 0 });
+        return;
+    }
+    emit_token(l, TOKEN_STRING, payload);
 }
 
-static void read_symbol(Lexer *l)
-{
-    char lhs = peek_next_char(l);
+//
+// Token matching
+// The DFA generated from tokens.spec (see tools/dfa_gen.c) runs from the cursor for as long as it has
+// a transition and remembers the last state that ends a token, which finds the longest match of all
+// rules in one pass. The action of that state either emits its fixed token or hands the match to one
+// of the routines above. Fixed tokens never contain a newline, only the routines track lines.
+//
 
-    Token_Type type = TOKEN_ERROR;
-    Token *token = make_token(type, l);
-    eat_char(l);
+// Returns the state the longest match at the cursor ends in, LEXER_DFA_DEAD if there is none
+static inline uint32_t lexer_match(Lexer *l, uint64_t *end)
+{
+    const uint8_t *data = l->data;
+    uint64_t pos = l->cursor;
+    uint32_t state = LEXER_DFA_START;
+    uint32_t accepted = LEXER_DFA_DEAD;
+    while (pos < l->size) {
+        state = lexer_dfa_next[(state << LEXER_DFA_CLASS_BITS) | lexer_dfa_class[data[pos]]];
+        if (state == LEXER_DFA_DEAD)
+            break;
+        ++pos;
+        if (lexer_dfa_action[state] != LEXER_ACTION_NONE) {
+            accepted = state;
+            *end = pos;
+        }
+    }
+    // The match could continue in input that hasn't been read yet
+    if (state != LEXER_DFA_DEAD && l->more_input)
+        l->incomplete = true;
+    return accepted;
+}
 
-    char rhs = peek_next_char(l);
+// Read the token or run of skipped bytes at the cursor
+static inline void lexer_step(Lexer *lexer)
+{
+    begin_token(lexer);
+    uint64_t end = lexer->cursor;
+    uint32_t state;
+    INSTRUMENT_CALL(INSTRUMENT_MATCH, state = lexer_match(lexer, &end));
+    if (lexer->incomplete)
+        return;
 
-    switch (lhs) {
-        case '+':
-            if (rhs == '=') type = TOKEN_PLUS_EQUALS;
-            break;
-        case '-':
-            if (rhs == '>') type = TOKEN_RIGHT_ARROW;
-            if (rhs == '=') type = TOKEN_MINUS_EQUALS;
-            break;
-        case '*':
-            if (rhs == '=') type = TOKEN_MUL_EQUALS;
-            break;
-        case '/':
-            if (rhs == '=') type = TOKEN_DIV_EQUALS;
-            break;
-        case '%':
-            if (rhs == '=') type = TOKEN_MOD_EQUALS;
+    Lexer_Action action = (Lexer_Action)lexer_dfa_action[state];
+    switch (action) {
+        case LEXER_ACTION_NONE:
+            // No rule starts with this byte
+            eat_char(lexer);
             break;
-        case '=':
-            if (rhs == '=') type = TOKEN_IS_EQUAL;
+        case LEXER_ACTION_TOKEN:
+            lexer->cursor = end;
+            emit_token(lexer, (Token_Type)lexer_dfa_token[state], (Token_Payload) { 0 });
             break;
-        case '!':
-            if (rhs == '=') type = TOKEN_IS_NOT_EQUAL;
+        case LEXER_ACTION_SKIP:
+            // The match is a single byte, skip the whole run from the start
+            if (lexer->track_lines) {
+                lexer->cursor = scan_whitespace(lexer->data, lexer->cursor, lexer->size, 
+                    &lexer->current_line, &lexer->line_start);
+            } else {
+                lexer->cursor = scan_skip(lexer->data, lexer->cursor, lexer->size);
+            }
             break;
-        case '&':
-            if (rhs == '&') type = TOKEN_LOGICAL_AND;
-            if (rhs == '=') type = TOKEN_BITWISE_AND_EQUALS;
+        case LEXER_ACTION_IDENTIFIER:
+            lexer->cursor = end;
+            INSTRUMENT_CALL(INSTRUMENT_READ_IDENTIFIER, read_identifier(lexer));
             break;
-        case '|':
-            if (rhs == '|') type = TOKEN_LOGICAL_OR;
-            if (rhs == '=') type = TOKEN_BITWISE_OR_EQUALS;
+        case LEXER_ACTION_NUMBER_DECIMAL:
+        case LEXER_ACTION_NUMBER_FLOAT:
+        case LEXER_ACTION_NUMBER_HEX:
+        case LEXER_ACTION_NUMBER_BINARY:
+            lexer->cursor = end;
+            INSTRUMENT_CALL(INSTRUMENT_READ_NUMBER, read_number(lexer, action));
             break;
-        case '^':
-            if (rhs == '=') type = TOKEN_BITWISE_XOR_EQUALS;
+        case LEXER_ACTION_STRING:
+            lexer->cursor = end;
+            INSTRUMENT_CALL(INSTRUMENT_READ_STRING, read_string(lexer));
             break;
-        case '<':
-            if (rhs == '=') type = TOKEN_LESS_EQUALS;
-            if (rhs == '<') type = TOKEN_SHIFT_LEFT;
+        case LEXER_ACTION_LINE_COMMENT:
+            lexer->cursor = end;
+            INSTRUMENT_CALL(INSTRUMENT_READ_COMMENT, read_line_comment(lexer));
             break;
-        case '>':
-            if (rhs == '=') type = TOKEN_GREATER_EQUALS;
-            if (rhs == '>') type = TOKEN_SHIFT_RIGHT;
+        case LEXER_ACTION_BLOCK_COMMENT:
+            lexer->cursor = end;
+            INSTRUMENT_CALL(INSTRUMENT_READ_COMMENT, read_block_comment(lexer));
             break;
     }
+}
 
-    if (type != TOKEN_ERROR) {
-        token->type = type;
-        // Consume extra character that was part of this symbol
-        eat_char(l);
-    } else {
-        // Implicit conversion to Token_Type (0-255)
-        token->type = lhs;
+// Lex until the first token boundary at or after `end`
+// Tokens starting before `end` are read to completion, even if they cross it.
+static void lexer_run(Lexer *lexer, uint64_t end)
+{
+    while (lexer->cursor < end)
+        lexer_step(lexer);
+}
+
+// Past this the arrays grow as they fill, so lexing a large file doesn't commit its whole estimate up front
+#define LEXER_ESTIMATE_MAX_TOKENS (64 * 1024)
+
+uint64_t lexer_estimate_tokens(uint64_t size)
+{
+    uint64_t estimate = size / 5;
+    return 256 + (estimate < LEXER_ESTIMATE_MAX_TOKENS ? estimate : LEXER_ESTIMATE_MAX_TOKENS);
+}
+
+// Lex `size` bytes at `data` into `tokens`, which keeps its capacity
+static void lexer_lex_tokens(const uint8_t *data, uint64_t size, Token **tokens, Atom_Table *atoms, 
+    Allocator *allocator)
+{
+    Lexer *lexer = &(Lexer) {
+        .data = data,
+        .size = size,
+        .track_lines = true,
+        .tokens = tokens,
+        .atoms = atoms,
+        .allocator = allocator,
+    };
+
+    array_reset(*tokens);
+    array_ensure(*tokens, lexer_estimate_tokens(size), allocator);
+    lexer_run(lexer, lexer->size);
+}
+
+// Returns the number of bytes lexed, or UINT64_MAX if the file can't be read
+// With a `cache` the tokens are loaded from it if it has the file, and stored in it otherwise
+static uint64_t lexer_read_file_sized(const char *path, Token_Cache *cache, Token **token_stream, 
+    Atom_Table *atoms, Allocator *allocator)
+{
+    uint64_t size = 0;
+    const uint8_t *data = os_map_file(path, &size);
+
+    if (data == 0) {
+        printf("Unable to read file: '%s'\n", path);
+        return UINT64_MAX;
+    }
+
+    uint64_t hash = cache ? token_cache_hash(data, size) : 0;
+    if (cache && token_cache_load(cache, hash, size, token_stream, atoms, allocator)) {
+        os_unmap_file(data, size);
+        return size;
     }
 
-    token->l1 = l->current_line;
-    token->c1 = l->current_char;
+    lexer_lex_tokens(data, size, token_stream, atoms, allocator);
+
+    if (cache)
+        token_cache_store(cache, hash, size, *token_stream, array_size(*token_stream), atoms);
+
+    os_unmap_file(data, size);
+    return size;
 }
 
 void lexer_read_file(const char *path, Token **token_stream, Atom_Table *atoms, Allocator *allocator)
+{
+    lexer_read_file_sized(path, 0, token_stream, atoms, allocator);
+}
+
+void lexer_context_init(Lexer_Context *ctx, Atom_Table *atoms, Allocator *allocator)
+{
+    *ctx = (Lexer_Context) {
+        .atoms = atoms ? atoms : atom_table_create(LEXER_CONTEXT_ATOMS),
+        .allocator = allocator,
+        .owns_atoms = atoms == 0,
+    };
+}
+
+void lexer_context_free(Lexer_Context *ctx)
+{
+    array_free(ctx->tokens, ctx->allocator);
+    if (ctx->owns_atoms)
+        atom_table_destroy(ctx->atoms);
+    *ctx = (Lexer_Context) { 0 };
+}
+
+uint64_t lexer_lex_buffer(Lexer_Context *ctx, const void *data, uint64_t size)
+{
+    lexer_lex_tokens(data, size, &ctx->tokens, ctx->atoms, ctx->allocator);
+    return array_size(ctx->tokens);
+}
+
+void lexer_read_source(const Source_File *file, Token **token_stream, Allocator *allocator)
+{
+    Lexer *lexer = &(Lexer) {
+        .data = file->data,
+        .size = file->size,
+        .track_lines = true,
+        .tokens = token_stream,
+        .spans = true,
+        .allocator = allocator,
+    };
+
+    array_reset(*token_stream);
+    array_ensure(*lexer->tokens, lexer_estimate_tokens(file->size), lexer->allocator);
+    lexer_run(lexer, lexer->size);
+}
+
+void lexer_read_file_cached(const char *path, Token_Cache *cache, Token **token_stream, Atom_Table *atoms, 
+    Allocator *allocator)
+{
+    lexer_read_file_sized(path, cache, token_stream, atoms, allocator);
+}
+
+void lexer_read_file_compact(const char *path, Token_Stream *stream, Line_Index *lines, Atom_Table *atoms, 
+    Allocator *allocator)
+{
+    uint64_t size = 0;
+    const uint8_t *data = os_map_file(path, &size);
+
+    if (data == 0) {
+        printf("Unable to read file: '%s'\n", path);
+        return;
+    }
+
+    if (size > UINT32_MAX) {
+        printf("File is too large for a compact token stream: '%s'\n", path);
+        os_unmap_file(data, size);
+        return;
+    }
+
+    Lexer *lexer = &(Lexer) {
+        .data = data,
+        .size = size,
+        .stream = stream,
+        .atoms = atoms,
+        .allocator = allocator,
+    };
+
+    token_stream_reset(stream);
+    token_stream_reserve(stream, lexer_estimate_tokens(size), allocator);
+    lexer_run(lexer, lexer->size);
+
+    if (lines)
+        line_index_build(lines, data, size, allocator);
+
+    os_unmap_file(data, size);
+}
+
+void lexer_read_file_packed(const char *path, Token_Pack *pack, Line_Index *lines, Atom_Table *atoms, 
+    Allocator *allocator)
 {
     uint64_t size = 0;
-    uint8_t *data = os_read_entire_file(path, &size, allocator);
+    const uint8_t *data = os_map_file(path, &size);
 
     if (data == 0) {
         printf("Unable to read file: '%s'\n", path);
         return;
     }
 
+    if (size > UINT32_MAX) {
+        printf("File is too large for a packed token stream: '%s'\n", path);
+        os_unmap_file(data, size);
+        return;
+    }
+
+    Lexer *lexer = &(Lexer) {
+        .data = data,
+        .size = size,
+        .pack = pack,
+        .atoms = atoms,
+        .allocator = allocator,
+    };
+
+    token_pack_reset(pack);
+    token_pack_reserve(pack, lexer_estimate_tokens(size), allocator);
+    lexer_run(lexer, lexer->size);
+
+    if (lines)
+        line_index_build(lines, data, size, allocator);
+
+    os_unmap_file(data, size);
+}
+
+//
+// Incremental re-lexing
+//
+// Tokens before the edit are kept up to the last one the edit can't change. The lexer reads at most
+// LEXER_DFA_LOOKAHEAD bytes past the end of a token while looking for a longer match, so a token
+// ending that close to the edit can grow into it or merge with what follows. An identifier that
+// `read_identifier` cut short ends at a code point that isn't XID_Continue, so the up to
+// UTF8_MAX_LENGTH bytes after it decide where it ends as well. From the end of the kept token the
+// lexer runs over the new text until it has passed the inserted bytes and stops at the start of a
+// token that the old stream has at the same place (shifted by the size change). The lexer keeps no
+// state between tokens, so everything from there on is unchanged and only needs its offsets moved.
+//
+
+#define LEXER_RELEX_LOOKAHEAD \
+    (LEXER_DFA_LOOKAHEAD > UTF8_MAX_LENGTH ? LEXER_DFA_LOOKAHEAD : UTF8_MAX_LENGTH)
+
+void lexer_relex(Token_Stream *stream, const uint8_t *data, uint64_t size, Lexer_Edit edit, Atom_Table *atoms,
+    Allocator *allocator)
+{
+    uint64_t old_size = token_stream_size(stream);
+    int64_t delta = (int64_t)edit.inserted - (int64_t)edit.removed;
+
+    // First token that ends within the lookahead of the edit, binary search as tokens are ordered
+    uint64_t first = 0, count = old_size;
+    while (count > 0) {
+        uint64_t half = count / 2;
+        uint64_t i = first + half;
+        uint64_t end = (uint64_t)token_stream_offset(stream, i) + token_stream_length(stream, i);
+        if (end + LEXER_RELEX_LOOKAHEAD <= edit.start) {
+            first = i + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+
+    uint64_t restart = first > 0
+        ? (uint64_t)token_stream_offset(stream, first - 1) + token_stream_length(stream, first - 1) : 0;
+    uint64_t edit_end = edit.start + edit.inserted;
+
+    Token_Stream relexed = { 0 };
     Lexer *lexer = &(Lexer) {
         .data = data,
         .size = size,
+        .cursor = restart,
+        .stream = &relexed,
+        .atoms = atoms,
+        .allocator = allocator,
+    };
+
+    // Old tokens [first, last) are replaced by the relexed ones
+    uint64_t last = first;
+    while (lexer->cursor < size) {
+        lexer_step(lexer);
+        if (lexer->cursor < edit_end)
+            continue;
+
+        uint64_t old_cursor = (uint64_t)((int64_t)lexer->cursor - delta);
+        while (last < old_size && token_stream_offset(stream, last) < old_cursor)
+            ++last;
+        if (last < old_size && token_stream_offset(stream, last) == old_cursor)
+            break;
+    }
+    if (lexer->cursor >= size)
+        last = old_size;
+
+    token_stream_splice(stream, first, last - first, &relexed, delta, allocator);
+    token_stream_free(&relexed, allocator);
+}
+
+//
+// Parallel lexing of a single file
+//
+// The file is split into chunks that start right after a newline, so columns inside a chunk are
+// already correct and lines only need the number of newlines before the chunk added. Every chunk
+// is lexed on its own thread assuming it doesn't start inside a comment or string.
+//
+// A chunk's lexer stops at the first token boundary at or after the end of the chunk. If that is
+// exactly where the next chunk starts, the guess for the next chunk was right. Otherwise a token,
+// comment or string crossed the boundary, and the lexer continues sequentially from where the previous
+// chunk stopped until it lands on the start of a token that the next chunk produced too. The lexer
+// keeps no state between tokens, so everything from that token on is identical to a sequential run.
+//
+// Atoms interned for speculative tokens that get discarded stay in the table.
+//
+
+#define LEXER_MIN_CHUNK_SIZE MB(1)
+
+typedef struct Lexer_Chunk {
+    Lexer lexer;
+    uint64_t start;
+    uint64_t end;
+    uint64_t newlines;
+    Token *tokens;
+    uint64_t *token_starts;
+} Lexer_Chunk;
+
+static void lex_chunk(void *user_data)
+{
+    Lexer_Chunk *chunk = user_data;
+    chunk->newlines = scan_count_newlines(chunk->lexer.data, chunk->start, chunk->end);
+    lexer_run(&chunk->lexer, chunk->end);
+}
+
+void lexer_read_file_parallel(const char *path, Token **token_stream, Atom_Table *atoms, Allocator *allocator,
+    uint32_t num_threads)
+{
+    uint64_t size = 0;
+    const uint8_t *data = os_map_file(path, &size);
+
+    if (data == 0) {
+        printf("Unable to read file: '%s'\n", path);
+        return;
+    }
+
+    if (num_threads == 0)
+        num_threads = os_num_cores();
+    if ((uint64_t)num_threads > size / LEXER_MIN_CHUNK_SIZE)
+        num_threads = (uint32_t)(size / LEXER_MIN_CHUNK_SIZE);
+
+    // Chunk boundaries are moved forward to the byte after the next newline
+    Lexer_Chunk *chunks = 0;
+    uint64_t start = 0;
+    for (uint32_t i = 0; i < num_threads && start < size; ++i) {
+        uint64_t end = size;
+        if (i + 1 < num_threads) {
+            uint64_t nominal = size / num_threads * (i + 1);
+            const uint8_t *nl = nominal > start ? memchr(data + nominal, '\n', size - nominal) : 0;
+            end = nl ? (uint64_t)(nl - data) + 1 : size;
+        }
+        Lexer_Chunk chunk = { .start = start, .end = end };
+        array_push(chunks, chunk, system_allocator);
+        start = end;
+    }
+
+    uint64_t num_chunks = array_size(chunks);
+    uint64_t *threads = 0;
+    for (uint64_t i = 0; i < num_chunks; ++i) {
+        Lexer_Chunk *chunk = &chunks[i];
+        chunk->lexer = (Lexer) {
+            .data = data,
+            .size = size,
+            .cursor = chunk->start,
+            .track_lines = true,
+            .line_start = chunk->start,
+            .tokens = &chunk->tokens,
+            .token_starts = &chunk->token_starts,
+            .atoms = atoms,
+            .allocator = system_allocator,
+        };
+        uint64_t estimate = lexer_estimate_tokens(chunk->end - chunk->start);
+        array_ensure(chunk->tokens, estimate, system_allocator);
+        array_ensure(chunk->token_starts, estimate, system_allocator);
+        // The first chunk runs on this thread
+        if (i > 0)
+            array_push(threads, os_thread_create(lex_chunk, chunk), system_allocator);
+    }
+    if (num_chunks > 0)
+        lex_chunk(&chunks[0]);
+    // Chunks whose thread couldn't be started are lexed here as well
+    for (uint64_t i = 0; i < array_size(threads); ++i) {
+        if (threads[i] == 0)
+            lex_chunk(&chunks[i + 1]);
+    }
+    for (uint64_t i = 0; i < array_size(threads); ++i) {
+        if (threads[i])
+            os_thread_join(threads[i]);
+    }
+
+    // Stitch the chunks together, starting from the first chunk which is always correct
+    array_reset(*token_stream);
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < num_chunks; ++i)
+        total += array_size(chunks[i].tokens);
+    array_ensure(*token_stream, total, allocator);
+
+    Lexer *repair = &(Lexer) {
+        .data = data,
+        .size = size,
+        .track_lines = true,
+        .tokens = token_stream,
+        .atoms = atoms,
+        .allocator = allocator,
+    };
+
+    uint64_t line_base = 0;
+    for (uint64_t i = 0; i < num_chunks; ++i) {
+        Lexer_Chunk *chunk = &chunks[i];
+        uint64_t num_tokens = array_size(chunk->tokens);
+        uint64_t first = 0;
+        bool synced = repair->cursor == chunk->start;
+
+        while (!synced && repair->cursor < chunk->end && repair->cursor < size) {
+            while (first < num_tokens && chunk->token_starts[first] < repair->cursor)
+                ++first;
+            if (first < num_tokens && chunk->token_starts[first] == repair->cursor) {
+                synced = true;
+                break;
+            }
+            lexer_step(repair);
+        }
+
+        if (synced) {
+            uint64_t dst = array_size(*token_stream);
+            array_join(*token_stream, chunk->tokens + first, num_tokens - first, allocator);
+            for (Token *it = *token_stream + dst; it != array_end(*token_stream); ++it) {
+                it->l0 += (int)line_base;
+                it->l1 += (int)line_base;
+            }
+            // Continue from where this chunk's lexer stopped
+            repair->cursor = chunk->lexer.cursor;
+            repair->current_line = chunk->lexer.current_line + (int)line_base;
+            repair->line_start = chunk->lexer.line_start;
+        }
+
+        line_base += chunk->newlines;
+        array_free(chunk->tokens, system_allocator);
+        array_free(chunk->token_starts, system_allocator);
+    }
+
+    // The last chunk ends at the end of the file, but a repair may still be short of it
+    lexer_run(repair, size);
+
+    array_free(threads, system_allocator);
+    array_free(chunks, system_allocator);
+    os_unmap_file(data, size);
+}
+
+//
+// Streaming
+//
+// The input is read through a window that is refilled whenever the lexer reaches its end. Every step
+// is checkpointed; when a step runs into the end of the window while more input follows, its token
+// may be cut short, so the step is undone, the unread tail is moved to the front of the window, and
+// it's lexed again after the refill. Identifiers and strings check this before interning, so no
+// partial atoms are created. Comments and whitespace aren't tokens and carry on after the refill
+// instead, see Lexer_Resume.
+//
+// The window only grows if a single token doesn't fit into it, up to LEXER_STREAM_MAX_WINDOW. A token
+// that doesn't fit into that either becomes a TOKEN_ERROR and the rest of it is skipped.
+//
+// Absolute positions don't exist here, `line_start` is kept relative to the window and may wrap
+// below zero when the window moves past it. Columns are computed with the same unsigned arithmetic,
+// so they stay correct.
+//
+
+#define LEXER_STREAM_MAX_WINDOW MB(64)
+
+// Continue what the last step before the refill was in the middle of
+static void lexer_resume(Lexer *l)
+{
+    Lexer_Resume resume = l->resume;
+    l->resume = LEXER_RESUME_NONE;
+    switch (resume) {
+        case LEXER_RESUME_NONE:
+            break;
+        case LEXER_RESUME_LINE_COMMENT:
+            read_line_comment(l);
+            break;
+        case LEXER_RESUME_BLOCK_COMMENT:
+            if (l->resume_escape && l->data[l->cursor] == '/')
+                l->cursor++;
+            else
+                read_block_comment(l);
+            break;
+        case LEXER_RESUME_STRING: {
+            uint64_t start = l->cursor;
+            bool escaped = l->resume_escape;
+            if (escaped)
+                eat_char(l);
+            bool non_ascii = false;
+            uint64_t end = scan_string(l->data, l->cursor, l->size, l->resume_quote, &l->current_line,
+                &l->line_start, &non_ascii);
+            l->cursor = end < l->size ? end + 1 : end;
+            if (end >= l->size && l->more_input) {
+                l->resume = LEXER_RESUME_STRING;
+                l->resume_escape = string_escape_pending(l->data, start, end, escaped);
+            }
+            break;
+        }
+        case LEXER_RESUME_MATCH: {
+            uint32_t state = l->resume_state;
+            while (l->cursor < l->size) {
+                uint32_t next = lexer_dfa_next[(state << LEXER_DFA_CLASS_BITS) | lexer_dfa_class[l->data[l->cursor]]];
+                if (next == LEXER_DFA_DEAD)
+                    break;
+                state = next;
+                l->cursor++;
+            }
+            if (l->cursor >= l->size && l->more_input) {
+                l->resume = LEXER_RESUME_MATCH;
+                l->resume_state = state;
+            }
+            break;
+        }
+    }
+}
+
+// The token at the cursor doesn't end within a window of LEXER_STREAM_MAX_WINDOW bytes. It becomes a
+// TOKEN_ERROR up to the end of the window and its rest is skipped after the refill.
+static void lexer_skip_overlong(Lexer *l)
+{
+    begin_token(l);
+    uint32_t state = LEXER_DFA_START;
+    uint64_t end = l->cursor;
+    while (l->cursor < l->size) {
+        uint32_t next = lexer_dfa_next[(state << LEXER_DFA_CLASS_BITS) | lexer_dfa_class[l->data[l->cursor]]];
+        if (next == LEXER_DFA_DEAD)
+            break;
+        state = next;
+        l->cursor++;
+        if (lexer_dfa_action[state] != LEXER_ACTION_NONE)
+            end = l->cursor;
+    }
+
+    if (l->cursor >= l->size) {
+        l->resume = LEXER_RESUME_MATCH;
+        l->resume_state = state;
+    } else {
+        // Comments carry on by themselves, so it's a string that matched its opening quote
+        bool non_ascii = false;
+        uint64_t start = end;
+        l->cursor = scan_string(l->data, start, l->size, l->data[l->token_start], &l->current_line,
+            &l->line_start, &non_ascii);
+        l->resume = LEXER_RESUME_STRING;
+        l->resume_quote = l->data[l->token_start];
+        l->resume_escape = string_escape_pending(l->data, start, l->cursor, false);
+    }
+    emit_token(l, TOKEN_ERROR, (Token_Payload) { 0 });
+}
+
+void lexer_read_stream(FILE *f, uint64_t window_size, Token **token_stream, Atom_Table *atoms, 
+    Allocator *allocator)
+{
+    if (window_size < 64)
+        window_size = 64;
+    uint8_t *window = c_alloc(allocator, window_size);
+
+    Lexer *lexer = &(Lexer) {
+        .data = window,
+        .track_lines = true,
+        .more_input = true,
         .tokens = token_stream,
         .atoms = atoms,
         .allocator = allocator,
     };
 
     array_reset(*token_stream);
-    array_ensure(*lexer->tokens, 256, lexer->allocator);
-
-    char c;
-    while ((c = peek_next_char(lexer)) >= 0) {
-        if (isalpha(c) || c == '_') {
-            // Read a text which is not a string literal
-            // E.g. keywords, variables, function names, parameters..
-            read_identifier(lexer);
-        } else if (isdigit(c)) {
-            // Read integer or floating point number
-            read_number(lexer);
-        } else if (c == '/') {
-            // Discard single or multi-line comments
-            read_comment(lexer);
-        } else if (c == '\'' || c == '\"') {
-            // Read string literal encapsulated within '' or ""
-            read_string(lexer);
-        } else if (isgraph(c)) {
-            // Read remaining symbols
-            // Also checks for nearby characters and consumes them accordingly
-            // E.g. +=, >=, ->, &&..
-            read_symbol(lexer);
-        } else {
-            // Skip characters that are not of interest
-            eat_char(lexer);
+    array_ensure(*lexer->tokens, lexer_estimate_tokens(window_size), lexer->allocator);
+
+    for (;;) {
+        while (lexer->more_input && lexer->size < window_size) {
+            uint64_t n = fread(window + lexer->size, 1, window_size - lexer->size, f);
+            lexer->size += n;
+            if (n == 0)
+                lexer->more_input = false;
         }
+
+        while (lexer->cursor < lexer->size) {
+            uint64_t cursor = lexer->cursor;
+            int current_line = lexer->current_line;
+            uint64_t line_start = lexer->line_start;
+            uint64_t num_tokens = array_size(*token_stream);
+
+            if (lexer->resume != LEXER_RESUME_NONE)
+                lexer_resume(lexer);
+            else
+                lexer_step(lexer);
+
+            if (lexer->more_input && lexer->incomplete) {
+                lexer->cursor = cursor;
+                lexer->current_line = current_line;
+                lexer->line_start = line_start;
+                lexer->incomplete = false;
+                array_header(*token_stream)->size = num_tokens;
+                break;
+            }
+        }
+
+        if (!lexer->more_input)
+            break;
+
+        if (lexer->cursor == 0) {
+            if (window_size < LEXER_STREAM_MAX_WINDOW) {
+                window = c_realloc(allocator, window, window_size, window_size * 2);
+                window_size *= 2;
+                lexer->data = window;
+                continue;
+            }
+            lexer_skip_overlong(lexer);
+        }
+
+        // Nothing before the cursor is looked at again
+        uint64_t keep_from = lexer->cursor;
+        memmove(window, window + keep_from, lexer->size - keep_from);
+        lexer->size -= keep_from;
+        lexer->cursor -= keep_from;
+        lexer->line_start -= keep_from;
+    }
+
+    c_free(allocator, window, window_size);
+}
+
+//
+// Batch lexing
+//
+// Every worker owns a range of file indices packed into one 64 bit word (begin in the low half,
+// end in the high half). Workers take files from the front of their own range, and once it's empty
+// they steal the back half of the fullest range they can find. Both sides update a range with a
+// single compare and swap, so no file is lexed twice or skipped.
+//
+
+typedef struct Lexer_Batch {
+    Lexer_Batch_File *files;
+    Atom_Table *atoms;
+    Allocator *allocator;
+    Token_Cache *cache;
+    uint32_t num_workers;
+    volatile uint64_t *ranges;
+} Lexer_Batch;
+
+typedef struct Lexer_Batch_Worker {
+    Lexer_Batch *batch;
+    uint32_t index;
+} Lexer_Batch_Worker;
+
+static inline uint64_t batch_range(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)begin | ((uint64_t)end << 32);
+}
+
+static bool batch_pop(Lexer_Batch *batch, uint32_t worker, uint32_t *file)
+{
+    volatile uint64_t *range = &batch->ranges[worker];
+    for (;;) {
+        uint64_t r = atomic_load_u64(range);
+        uint32_t begin = (uint32_t)r;
+        uint32_t end = (uint32_t)(r >> 32);
+        if (begin >= end)
+            return false;
+        if (atomic_cas_u64(range, r, batch_range(begin + 1, end))) {
+            *file = begin;
+            return true;
+        }
+    }
+}
+
+static bool batch_steal(Lexer_Batch *batch, uint32_t worker)
+{
+    for (;;) {
+        uint32_t victim = UINT32_MAX;
+        uint32_t most = 0;
+        uint64_t victim_range = 0;
+        for (uint32_t i = 0; i < batch->num_workers; ++i) {
+            uint64_t r = atomic_load_u64(&batch->ranges[i]);
+            uint32_t remaining = (uint32_t)(r >> 32) - (uint32_t)r;
+            if ((uint32_t)r < (uint32_t)(r >> 32) && remaining > most) {
+                victim = i;
+                most = remaining;
+                victim_range = r;
+            }
+        }
+        if (victim == UINT32_MAX)
+            return false;
+
+        uint32_t begin = (uint32_t)victim_range;
+        uint32_t end = (uint32_t)(victim_range >> 32);
+        uint32_t mid = end - (most + 1) / 2;
+        if (atomic_cas_u64(&batch->ranges[victim], victim_range, batch_range(begin, mid))) {
+            atomic_store_u64(&batch->ranges[worker], batch_range(mid, end));
+            return true;
+        }
+    }
+}
+
+static void batch_worker(void *user_data)
+{
+    Lexer_Batch_Worker *worker = user_data;
+    Lexer_Batch *batch = worker->batch;
+
+    uint32_t file;
+    do {
+        while (batch_pop(batch, worker->index, &file)) {
+            Lexer_Batch_File *f = &batch->files[file];
+            uint64_t size = lexer_read_file_sized(f->path, batch->cache, &f->tokens, batch->atoms, batch->allocator);
+            f->failed = size == UINT64_MAX;
+            f->size = f->failed ? 0 : size;
+        }
+    } while (batch_steal(batch, worker->index));
+}
+
+void lexer_read_files(Lexer_Batch_File *files, uint32_t num_files, Atom_Table *atoms, Allocator *allocator,
+    uint32_t num_threads, Token_Cache *cache)
+{
+    if (num_threads == 0)
+        num_threads = os_num_cores();
+    if (num_threads > num_files)
+        num_threads = num_files ? num_files : 1;
+
+    Lexer_Batch batch = {
+        .files = files,
+        .atoms = atoms,
+        .allocator = allocator,
+        .cache = cache,
+        .num_workers = num_threads,
+    };
+
+    uint64_t *ranges = 0;
+    Lexer_Batch_Worker *workers = 0;
+    for (uint32_t i = 0; i < num_threads; ++i) {
+        uint32_t begin = (uint32_t)((uint64_t)num_files * i / num_threads);
+        uint32_t end = (uint32_t)((uint64_t)num_files * (i + 1) / num_threads);
+        array_push(ranges, batch_range(begin, end), system_allocator);
+        array_push(workers, ((Lexer_Batch_Worker) { &batch, i }), system_allocator);
+    }
+    batch.ranges = ranges;
+
+    // Worker 0 runs on this thread
+    uint64_t *threads = 0;
+    for (uint32_t i = 1; i < num_threads; ++i)
+        array_push(threads, os_thread_create(batch_worker, &workers[i]), system_allocator);
+    batch_worker(&workers[0]);
+    // Workers whose thread couldn't be started run here too, worker 0 has usually stolen their files
+    // by then
+    for (uint64_t i = 0; i < array_size(threads); ++i) {
+        if (threads[i] == 0)
+            batch_worker(&workers[i + 1]);
+    }
+    for (uint64_t i = 0; i < array_size(threads); ++i) {
+        if (threads[i])
+            os_thread_join(threads[i]);
     }
 
-    c_free(allocator, data, size);
+    array_free(threads, system_allocator);
+    array_free(workers, system_allocator);
+    array_free(ranges, system_allocator);
 }
@@ -4,6 +4,14 @@
 struct Atom;
 struct Atom_Table;
 struct Allocator;
+struct Token_Stream;
+struct Token_Pack;
+struct Line_Index;
+struct Token_Cache;
+struct Source_File;
+
+// LEXER_OPERATORS and LEXER_KEYWORDS, generated from tokens.spec
+#include "lexer_tokens.h"
 
 typedef enum Token_Type {
     // ASCII characters 0-255
@@ -12,69 +20,210 @@ typedef enum Token_Type {
     TOKEN_NUMBER = 257,
     TOKEN_STRING = 258,
 
-    TOKEN_PLUS_EQUALS = 259,
-    TOKEN_MINUS_EQUALS = 260,
-    TOKEN_MUL_EQUALS = 261,
-    TOKEN_DIV_EQUALS = 262,
-    TOKEN_MOD_EQUALS = 263,
-    TOKEN_IS_EQUAL = 264,
-    TOKEN_IS_NOT_EQUAL = 265,
-    TOKEN_LOGICAL_AND = 266,
-    TOKEN_LOGICAL_OR = 267,
-    TOKEN_LESS_EQUALS = 268,
-    TOKEN_GREATER_EQUALS = 269,
-
-    TOKEN_RIGHT_ARROW = 270, // -> 
-    
-    TOKEN_SHIFT_LEFT = 271,
-    TOKEN_SHIFT_RIGHT = 272,
-    TOKEN_BITWISE_AND_EQUALS = 273,
-    TOKEN_BITWISE_OR_EQUALS = 274,
-    TOKEN_BITWISE_XOR_EQUALS = 275,
-
-    // Keywords
-    TOKEN_KEYWORD_IF = 276,
-    TOKEN_KEYWORD_ELSE,
-    TOKEN_KEYWORD_THEN,
-    TOKEN_KEYWORD_CASE,
-    TOKEN_KEYWORD_RETURN,
-    TOKEN_KEYWORD_STRUCT,
-    TOKEN_KEYWORD_ENUM,
-    TOKEN_KEYWORD_WHILE,
-    TOKEN_KEYWORD_BREAK,
-    TOKEN_KEYWORD_CONTINUE,
-    TOKEN_KEYWORD_SWITCH,
-    TOKEN_KEYWORD_DEFER,
-    TOKEN_KEYWORD_SIZE_OF,
-    TOKEN_KEYWORD_TYPE_OF,
-    TOKEN_KEYWORD_TRUE,
-    TOKEN_KEYWORD_FALSE,
-    TOKEN_KEYWORD_NULL,
+    // Operators, 259-511 in the order of tokens.spec
+#define LEXER_OPERATOR_ENUM(name, str) TOKEN_##name,
+    LEXER_OPERATORS(LEXER_OPERATOR_ENUM)
+#undef LEXER_OPERATOR_ENUM
+    TOKEN_OPERATOR_LAST,
+
+    // Keywords, 512-767 in the order of tokens.spec. They start at a fixed type so that adding an
+    // operator doesn't renumber them.
+    TOKEN_KEYWORD_BASE = 511,
+#define LEXER_KEYWORD_ENUM(name, str) TOKEN_KEYWORD_##name,
+    LEXER_KEYWORDS(LEXER_KEYWORD_ENUM)
+#undef LEXER_KEYWORD_ENUM
     TOKEN_KEYWORD_LAST,
 
-    TOKEN_ERROR,
+    TOKEN_ERROR = 768,
 } Token_Type;
 
-static const char *keyword_strings[] = {
-    "if", "else", "then", "case", "return", "struct",
-    "enum", "while", "break", "continue", "defer", "switch",
-    "sizeof", "typeof", "true", "false", "null",
+#define TOKEN_OPERATOR_FIRST (TOKEN_STRING + 1)
+#define TOKEN_KEYWORD_FIRST (TOKEN_KEYWORD_BASE + 1)
+
+//
+// Every type has a byte code, for storage that packs tokens tighter than Token. Characters below 128
+// are their own code, types 256-319 (identifiers, numbers, strings and operators) are 128-191,
+// keywords 512-573 are 192-253 and TOKEN_ERROR is 254. 255 is never a code. tools/dfa_gen.c rejects
+// specs with more operators or keywords than that, or chars that aren't ASCII.
+//
+#define TOKEN_CODE_ERROR 254
+#define TOKEN_CODE_NONE 255
+
+static inline uint8_t token_type_code(Token_Type type)
+{
+    if (type < 128)
+        return (uint8_t)type;
+    if (type >= TOKEN_IDENTIFIER && type < TOKEN_IDENTIFIER + 64)
+        return (uint8_t)(type - TOKEN_IDENTIFIER + 128);
+    if (type >= TOKEN_KEYWORD_FIRST && type < TOKEN_KEYWORD_FIRST + 62)
+        return (uint8_t)(type - TOKEN_KEYWORD_FIRST + 192);
+    return type == TOKEN_ERROR ? TOKEN_CODE_ERROR : TOKEN_CODE_NONE;
+}
+
+static inline Token_Type token_code_type(uint8_t code)
+{
+    if (code < 128)
+        return (Token_Type)code;
+    if (code < 192)
+        return (Token_Type)(TOKEN_IDENTIFIER + code - 128);
+    if (code < TOKEN_CODE_ERROR)
+        return (Token_Type)(TOKEN_KEYWORD_FIRST + code - 192);
+    return TOKEN_ERROR;
+}
+
+#define LEXER_TOKEN_STRING(name, str) str,
+static const char *const operator_strings[] = {
+    LEXER_OPERATORS(LEXER_TOKEN_STRING)
+};
+static const char *const keyword_strings[] = {
+    LEXER_KEYWORDS(LEXER_TOKEN_STRING)
+};
+#undef LEXER_TOKEN_STRING
+
+#define LEXER_TOKEN_LENGTH(name, str) sizeof(str) - 1,
+static const uint8_t operator_lengths[] = {
+    LEXER_OPERATORS(LEXER_TOKEN_LENGTH)
+};
+static const uint8_t keyword_lengths[] = {
+    LEXER_KEYWORDS(LEXER_TOKEN_LENGTH)
 };
+#undef LEXER_TOKEN_LENGTH
+
+// Bytes [offset, offset + length) of the source a token was lexed from
+typedef struct Token_Span {
+    uint32_t offset;
+    uint32_t length;
+} Token_Span;
 
 typedef struct Token {
     Token_Type type;
     int l0, c0, l1, c1;
     union {
-        struct Atom *name;
+        // Atom id of identifiers and strings, resolve it with `atom_get`
+        uint32_t name;
+        // Text of identifiers and strings lexed with `lexer_read_source`, in place of `name`
+        Token_Span span;
         uint64_t int_value;
         double float_value;
-        String8 string_value;
     };
 } Token;
 
+//
+// Number of tokens to make room for up front when lexing `size` bytes, so the token arrays of ordinary
+// source don't have to grow while lexing. Source averages 6-7 bytes per token, this errs on the high side.
+// Capped at 64K tokens, larger inputs grow their arrays past that.
+//
+uint64_t lexer_estimate_tokens(uint64_t size);
+
 // 
 // Read file at `path` and parse its data into a stream of tokens `token_stream`
 // Any parsed identifiers and strings are added to the Atom_Table
 //
 void lexer_read_file(const char *path, Token **token_stream, struct Atom_Table *atoms, struct Allocator *allocator);
 
+//
+// Lexing text that's already in memory
+// A Lexer_Context holds what lexing one buffer leaves behind for the next: the token array, which
+// keeps its capacity, and the atom table, so identifiers seen before aren't stored again. Once the
+// array has grown to fit the largest buffer, lexing does no file I/O and allocates nothing but
+// new atoms.
+//
+
+typedef struct Lexer_Context {
+    struct Atom_Table *atoms;
+    struct Allocator *allocator;
+    // Tokens of the last `lexer_lex_buffer`, overwritten by the next one
+    Token *tokens;
+    bool owns_atoms;
+} Lexer_Context;
+
+// Capacity of the atom table a context creates for itself
+#define LEXER_CONTEXT_ATOMS MB(16)
+
+// Identifiers and strings are interned into `atoms`, or into a table owned by the context if it's 0
+void lexer_context_init(Lexer_Context *ctx, struct Atom_Table *atoms, struct Allocator *allocator);
+void lexer_context_free(Lexer_Context *ctx);
+
+// Lex `size` bytes at `data` into `ctx->tokens` and return the number of tokens. The tokens don't
+// point into `data`, it can be released as soon as this returns.
+uint64_t lexer_lex_buffer(Lexer_Context *ctx, const void *data, uint64_t size);
+
+//
+// Same as `lexer_read_file`, but nothing is interned. Identifier and string tokens carry the `span` of
+// their text in `file` instead of a `name`, so they are only valid while the file is open. Resolve
+// them with `source_file_text`, or intern them on demand with `source_file_atom`.
+//
+void lexer_read_source(const struct Source_File *file, Token **token_stream, struct Allocator *allocator);
+
+//
+// Same as `lexer_read_file`, but the tokens are loaded from `cache` when it has a file with the same
+// contents, and stored in it after lexing otherwise. Hits and misses are counted in the cache.
+//
+void lexer_read_file_cached(const char *path, struct Token_Cache *cache, Token **token_stream, 
+    struct Atom_Table *atoms, struct Allocator *allocator);
+
+//
+// Same as `lexer_read_file`, but the file is split into chunks that are lexed on `num_threads` threads
+// (0 uses one per core) and stitched back into the same stream a sequential run produces
+//
+void lexer_read_file_parallel(const char *path, Token **token_stream, struct Atom_Table *atoms, 
+    struct Allocator *allocator, uint32_t num_threads);
+
+//
+// Lex everything read from `f` until end of file, which can be a pipe or stdin. The input goes through
+// a refilled window of `window_size` bytes instead of being read into memory at once, so memory use
+// is bounded by the window and the output. Comments continue across refills, the window is only grown
+// for a token longer than it and a token that doesn't fit into 64MB becomes a TOKEN_ERROR.
+//
+void lexer_read_stream(FILE *f, uint64_t window_size, Token **token_stream, struct Atom_Table *atoms, 
+    struct Allocator *allocator);
+
+typedef struct Lexer_Batch_File {
+    const char *path;
+    // Filled in by `lexer_read_files`
+    Token *tokens;
+    uint64_t size;
+    bool failed;
+} Lexer_Batch_File;
+
+//
+// Lex every file in `files` into its own token stream, distributed over `num_threads` threads 
+// (0 uses one per core) that steal files from each other when they run out. All identifiers and 
+// strings are interned into the shared `atoms`. Files are looked up in and added to `cache` if set.
+//
+void lexer_read_files(Lexer_Batch_File *files, uint32_t num_files, struct Atom_Table *atoms, 
+    struct Allocator *allocator, uint32_t num_threads, struct Token_Cache *cache);
+
+//
+// Same as `lexer_read_file` but stores the tokens in the compact structure-of-arrays `stream`
+// Tokens carry byte offsets into the file instead of line and column positions, no lines are
+// tracked while lexing. If `lines` is set it's filled with the line starts of the file so
+// offsets can be resolved with `line_index_lookup`.
+//
+void lexer_read_file_compact(const char *path, struct Token_Stream *stream, struct Line_Index *lines, 
+    struct Atom_Table *atoms, struct Allocator *allocator);
+
+//
+// Same as `lexer_read_file_compact` but the tokens are encoded into `pack` as they are lexed, a few
+// bytes each. Read them back with a Token_Pack_Iterator.
+//
+void lexer_read_file_packed(const char *path, struct Token_Pack *pack, struct Line_Index *lines, 
+    struct Atom_Table *atoms, struct Allocator *allocator);
+
+// Bytes [start, start + removed) of the old text were replaced by `inserted` bytes
+typedef struct Lexer_Edit {
+    uint64_t start;
+    uint64_t removed;
+    uint64_t inserted;
+} Lexer_Edit;
+
+//
+// Update a compact token `stream` after an edit, without lexing the whole text again
+// `data` is the full text after the edit, the replacement bytes are at [edit.start, edit.start + edit.inserted).
+// Only the tokens from the last one before the edit up to where the lexer lines up with the old
+// stream again are re-lexed, later tokens just have their offsets moved. An empty stream together
+// with an edit inserting the whole text does a full lex. Use `line_index_update` to keep a line
+// index in sync.
+//
+void lexer_relex(struct Token_Stream *stream, const uint8_t *data, uint64_t size, Lexer_Edit edit, 
+    struct Atom_Table *atoms, struct Allocator *allocator);
@@ -0,0 +1,48 @@
+#pragma once
+
+//
+// Generated by tools/dfa_gen.c from src/tokens.spec, do not edit
+//
+
+#define LEXER_OPERATORS(X) \
+    X(PLUS_EQUALS, "+=") \
+    X(MINUS_EQUALS, "-=") \
+    X(MUL_EQUALS, "*=") \
+    X(DIV_EQUALS, "/=") \
+    X(MOD_EQUALS, "%=") \
+    X(IS_EQUAL, "==") \
+    X(IS_NOT_EQUAL, "!=") \
+    X(LOGICAL_AND, "&&") \
+    X(LOGICAL_OR, "||") \
+    X(LESS_EQUALS, "<=") \
+    X(GREATER_EQUALS, ">=") \
+    X(RIGHT_ARROW, "->") \
+    X(SHIFT_LEFT, "<<") \
+    X(SHIFT_RIGHT, ">>") \
+    X(BITWISE_AND_EQUALS, "&=") \
+    X(BITWISE_OR_EQUALS, "|=") \
+    X(BITWISE_XOR_EQUALS, "^=") \
+    X(SHIFT_LEFT_EQUALS, "<<=") \
+    X(SHIFT_RIGHT_EQUALS, ">>=") \
+    X(ELLIPSIS, "...") \
+    X(DOUBLE_COLON, "::") \
+
+#define LEXER_KEYWORDS(X) \
+    X(IF, "if") \
+    X(ELSE, "else") \
+    X(THEN, "then") \
+    X(CASE, "case") \
+    X(RETURN, "return") \
+    X(STRUCT, "struct") \
+    X(ENUM, "enum") \
+    X(WHILE, "while") \
+    X(BREAK, "break") \
+    X(CONTINUE, "continue") \
+    X(SWITCH, "switch") \
+    X(DEFER, "defer") \
+    X(SIZE_OF, "sizeof") \
+    X(TYPE_OF, "typeof") \
+    X(TRUE, "true") \
+    X(FALSE, "false") \
+    X(NULL, "null") \
+
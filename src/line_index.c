@@ -0,0 +1,75 @@
+#include "line_index.h"
+#include "char_class.h"
+#include "foundation/array.h"
+
+void line_index_build(Line_Index *index, const uint8_t *data, uint64_t size, Allocator *a)
+{
+    array_reset(index->line_starts);
+    array_push(index->line_starts, 0, a);
+
+    uint64_t pos = 0;
+#if defined(SCAN_BLOCK)
+    for (; pos + SCAN_BLOCK <= size; pos += SCAN_BLOCK) {
+        uint32_t nl = scan__newline_mask(data + pos);
+        while (nl) {
+            array_push(index->line_starts, (uint32_t)(pos + bits_ctz32(nl) + 1), a);
+            nl &= nl - 1;
+        }
+    }
+#endif
+    for (; pos < size; ++pos) {
+        if (data[pos] == '\n')
+            array_push(index->line_starts, (uint32_t)(pos + 1), a);
+    }
+}
+
+void line_index_free(Line_Index *index, Allocator *a)
+{
+    array_free(index->line_starts, a);
+}
+
+void line_index_update(Line_Index *index, const uint8_t *data, uint64_t start, uint64_t removed, uint64_t inserted,
+    Allocator *a)
+{
+    if (!index->line_starts)
+        array_push(index->line_starts, 0, a);
+
+    // Lines starting inside (start, start + removed] came from removed newlines
+    uint64_t first = 0;
+    uint64_t size = array_size(index->line_starts);
+    while (first < size && index->line_starts[first] <= start)
+        ++first;
+    uint64_t last = first;
+    while (last < size && index->line_starts[last] <= start + removed)
+        ++last;
+
+    uint32_t *added = 0;
+    for (uint64_t pos = start; pos < start + inserted; ++pos) {
+        if (data[pos] == '\n')
+            array_push(added, (uint32_t)(pos + 1), a);
+    }
+
+    uint64_t num_added = array_size(added);
+    array_splice(index->line_starts, first, last - first, added, num_added, a);
+    array_free(added, a);
+
+    int64_t delta = (int64_t)inserted - (int64_t)removed;
+    for (uint64_t i = first + num_added; i < array_size(index->line_starts); ++i)
+        index->line_starts[i] = (uint32_t)((int64_t)index->line_starts[i] + delta);
+}
+
+void line_index_lookup(const Line_Index *index, uint64_t offset, int *line, int *col)
+{
+    // Find the last line starting at or before `offset`
+    uint64_t lo = 0;
+    uint64_t hi = array_size(index->line_starts);
+    while (hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if (index->line_starts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    *line = (int)lo;
+    *col = (int)(offset - (index->line_starts ? index->line_starts[lo] : 0)) + 1;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "foundation/basic.h"
+
+struct Allocator;
+
+// Offsets of the first byte of every line, used to resolve byte offsets into positions on demand
+// instead of tracking lines and columns for every byte while lexing
+typedef struct Line_Index {
+    uint32_t *line_starts;
+} Line_Index;
+
+void line_index_build(Line_Index *index, const uint8_t *data, uint64_t size, struct Allocator *a);
+void line_index_free(Line_Index *index, struct Allocator *a);
+
+// Update the index after [start, start + removed) was replaced by `inserted` bytes, `data` is the new text
+void line_index_update(Line_Index *index, const uint8_t *data, uint64_t start, uint64_t removed, uint64_t inserted,
+    struct Allocator *a);
+
+// Resolve `offset` into a 0-based line and 1-based column, the same convention as Token
+void line_index_lookup(const Line_Index *index, uint64_t offset, int *line, int *col);
@@ -1,28 +1,274 @@
-#pragma once
 #include "foundation/basic.h"
 #include "foundation/array.h"
 #include "foundation/atom.h"
+#include "foundation/instrument.h"
 #include "foundation/os_helper.h"
 #include "lexer.h"
+#include "line_index.h"
+#include "source_file.h"
+#include "token_cache.h"
+#include "token_pack.h"
+#include "token_stream.h"
 #include "token_util.h"
+#include "token_writer.h"
+
+// Token arrays get this much address space each, so they grow by committing pages in place instead
+// of being copied to a bigger block
+#define TOKEN_ARRAY_RESERVE GB(64)
+
+#if defined(LEXER_INSTRUMENT)
+static const char *instrument_token_name(uint32_t type)
+{
+    return token_type_name((Token) { .type = (Token_Type)type });
+}
+#endif
+
+// Summaries go to stderr when stdout carries machine-readable tokens
+static FILE *info_output(Token_Format format)
+{
+    return format == TOKEN_FORMAT_HUMAN ? stdout : stderr;
+}
+
+static bool parse_format(const char *name, Token_Format *format)
+{
+    static const char *names[] = { "human", "jsonl", "binary" };
+    for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            *format = (Token_Format)i;
+            return true;
+        }
+    }
+    printf("Unknown token format: '%s', expected human, jsonl or binary\n", name);
+    return false;
+}
+
+static int lex_compact(const char *path, Atom_Table *atoms, Token_Format format)
+{
+    Allocator token_allocator = allocator_create_fixed_vm(TOKEN_ARRAY_RESERVE);
+    Token_Stream stream = { 0 };
+    Line_Index lines = { 0 };
+    uint64_t start_time = os_time_now();
+    lexer_read_file_compact(path, &stream, &lines, atoms, &token_allocator);
+    double delta = os_time_delta(os_time_now(), start_time);
+
+    Token_Writer writer;
+    token_writer_init(&writer, stdout, format, system_allocator);
+    token_writer_write_compact(&writer, &stream, &lines, atoms);
+    if (!token_writer_finish(&writer))
+        fprintf(stderr, "Failed to write tokens\n");
+
+    FILE *info = info_output(format);
+    uint64_t num_tokens = token_stream_size(&stream);
+    fprintf(info, "Parsed %zu tokens in %.4fs.\n", num_tokens, delta);
+    fprintf(info, "Compact token stream size = %.2fKB (%.2f bytes per token)", 
+        token_stream_bytes(&stream) / 1000.f, num_tokens ? (double)token_stream_bytes(&stream) / num_tokens : 0.0);
+
+    token_stream_free(&stream, &token_allocator);
+    line_index_free(&lines, &token_allocator);
+    return 0;
+}
+
+static int lex_packed(const char *path, Atom_Table *atoms, Token_Format format)
+{
+    Allocator token_allocator = allocator_create_fixed_vm(TOKEN_ARRAY_RESERVE);
+    Token_Pack pack = { 0 };
+    Line_Index lines = { 0 };
+    uint64_t start_time = os_time_now();
+    lexer_read_file_packed(path, &pack, &lines, atoms, &token_allocator);
+    double delta = os_time_delta(os_time_now(), start_time);
+
+    // One pass over every token, to compare decoding with lexing again
+    uint64_t decode_start = os_time_now();
+    uint64_t check = 0;
+    for (Token_Pack_Iterator it = token_pack_iterator(&pack, 0); token_pack_iterator_valid(&it); 
+        token_pack_iterator_next(&it)) {
+        check += it.type + it.offset + it.length + it.payload.int_value;
+    }
+    double decode_delta = os_time_delta(os_time_now(), decode_start);
+
+    Token_Writer writer;
+    token_writer_init(&writer, stdout, format, system_allocator);
+    token_writer_write_packed(&writer, &pack, &lines, atoms);
+    if (!token_writer_finish(&writer))
+        fprintf(stderr, "Failed to write tokens\n");
+
+    FILE *info = info_output(format);
+    uint64_t num_tokens = token_pack_size(&pack);
+    fprintf(info, "Parsed %zu tokens in %.4fs, decoded in %.4fs (checksum %zx).\n", 
+        num_tokens, delta, decode_delta, check);
+    fprintf(info, "Packed token stream size = %.2fKB (%.2f bytes per token)", 
+        token_pack_bytes(&pack) / 1000.f, num_tokens ? (double)token_pack_bytes(&pack) / num_tokens : 0.0);
+
+    token_pack_free(&pack, &token_allocator);
+    line_index_free(&lines, &token_allocator);
+    return 0;
+}
+
+static void add_batch_file(const char *path, void *user_data)
+{
+    Lexer_Batch_File **files = user_data;
+    uint64_t len = strlen(path);
+    char *copy = malloc(len + 1);
+    memcpy(copy, path, len + 1);
+    Lexer_Batch_File file = { .path = copy };
+    array_push(*files, file, system_allocator);
+}
+
+// `path` is either a directory that's searched recursively, or a text file listing one path per line
+static int lex_batch(const char *path, Atom_Table *atoms, uint32_t num_threads, Token_Cache *cache)
+{
+    Lexer_Batch_File *files = 0;
+    if (os_is_directory(path)) {
+        os_list_files(path, add_batch_file, &files);
+    } else {
+        uint64_t size = 0;
+        char *list = os_read_entire_file(path, &size, system_allocator);
+        if (list == 0) {
+            printf("Unable to read file list: '%s'\n", path);
+            return 1;
+        }
+        for (char *line = list, *end = list + size; line < end;) {
+            char *next = memchr(line, '\n', end - line);
+            char *line_end = next ? next : end;
+            while (line_end > line && (line_end[-1] == '\r' || line_end[-1] == ' '))
+                --line_end;
+            if (line_end > line) {
+                char buf[4096];
+                snprintf(buf, sizeof(buf), "%.*s", (int)(line_end - line), line);
+                add_batch_file(buf, &files);
+            }
+            line = next ? next + 1 : end;
+        }
+        c_free(system_allocator, list, size);
+    }
+
+    uint64_t start_time = os_time_now();
+    lexer_read_files(files, (uint32_t)array_size(files), atoms, system_allocator, num_threads, cache);
+    double delta = os_time_delta(os_time_now(), start_time);
+
+    uint64_t num_bytes = 0;
+    uint64_t num_tokens = 0;
+    uint64_t num_failed = 0;
+    for (Lexer_Batch_File *it = files; it != array_end(files); ++it) {
+        num_bytes += it->size;
+        num_tokens += array_size(it->tokens);
+        num_failed += it->failed;
+        array_free(it->tokens, system_allocator);
+        free((void *)it->path);
+    }
+
+    printf("Parsed %zu files (%zu failed), %zu tokens, %.2fMB in %.4fs.\n", 
+        array_size(files), num_failed, num_tokens, num_bytes / 1e6, delta);
+    printf("Throughput: %.2fMB/s, %.2fM tokens/s", 
+        delta > 0 ? num_bytes / 1e6 / delta : 0.0, delta > 0 ? num_tokens / 1e6 / delta : 0.0);
+
+    array_free(files, system_allocator);
+    return 0;
+}
 
 int main(int argc, char **argv) {
     Atom_Table *atoms = atom_table_create(MB(16));
+    Allocator token_allocator = allocator_create_fixed_vm(TOKEN_ARRAY_RESERVE);
     Token *tokens = 0;
 
+    const char *path = "first.ps";
+    bool compact = false;
+    bool packed = false;
+    bool parallel = false;
+    bool batch = false;
+    bool stream = false;
+    bool spans = false;
+    Token_Format format = TOKEN_FORMAT_HUMAN;
+    uint64_t window_size = MB(1);
+    uint32_t num_threads = 0;
+    // Directory of the token cache, no cache is used without one
+    const char *cache_dir = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--compact") == 0)
+            compact = true;
+        else if (strcmp(argv[i], "--packed") == 0)
+            packed = true;
+        else if (strcmp(argv[i], "--parallel") == 0)
+            parallel = true;
+        else if (strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = true;
+        else if (strcmp(argv[i], "--spans") == 0)
+            spans = true;
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc)
+            window_size = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            num_threads = (uint32_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!parse_format(argv[++i], &format))
+                return 1;
+        }
+        else
+            path = argv[i];
+    }
+
+    Token_Cache cache = { .dir = cache_dir };
+
+    if (compact || packed || batch) {
+        int res = compact ? lex_compact(path, atoms, format) 
+            : packed ? lex_packed(path, atoms, format) 
+            : lex_batch(path, atoms, num_threads, cache_dir ? &cache : 0);
+        if (batch && cache_dir) {
+            printf("\n");
+            token_cache_print_stats(&cache, stdout);
+        }
+        INSTRUMENT_REPORT(instrument_token_name);
+        atom_table_destroy(atoms);
+        return res;
+    }
+
+    // With spans the file stays mapped until the tokens are printed
+    Source_File source = { 0 };
+
     uint64_t start_time = os_time_now();
-    const char *path = argc > 1 ? argv[1] : "first.ps";
-    lexer_read_file(path, &tokens, atoms, system_allocator);
+    if (spans) {
+        if (source_file_open(&source, path))
+            lexer_read_source(&source, &tokens, &token_allocator);
+    } else if (parallel) {
+        lexer_read_file_parallel(path, &tokens, atoms, &token_allocator, num_threads);
+    } else if (stream) {
+        // "-" reads from stdin
+        FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+        if (f) {
+            lexer_read_stream(f, window_size, &tokens, atoms, &token_allocator);
+            if (f != stdin)
+                fclose(f);
+        } else {
+            printf("Unable to read file: '%s'\n", path);
+        }
+    } else if (cache_dir)
+        lexer_read_file_cached(path, &cache, &tokens, atoms, &token_allocator);
+    else
+        lexer_read_file(path, &tokens, atoms, &token_allocator);
     double delta = os_time_delta(os_time_now(), start_time);
 
-    print_token_stream(&tokens);
-    
-    printf("Parsed %zu tokens in %.4fs.\n", array_size(tokens), delta);
-    printf("Token stream size = %.2fKB (1 token is %zu bytes)", 
+    Token_Writer writer;
+    token_writer_init(&writer, stdout, format, system_allocator);
+    token_writer_write(&writer, tokens, array_size(tokens), atoms, spans ? &source : 0);
+    if (!token_writer_finish(&writer))
+        fprintf(stderr, "Failed to write tokens\n");
+
+    FILE *info = info_output(format);
+    fprintf(info, "Parsed %zu tokens in %.4fs.\n", array_size(tokens), delta);
+    fprintf(info, "Token stream size = %.2fKB (1 token is %zu bytes)", 
         (sizeof(Token) * array_size(tokens)) / 1000.f, sizeof(Token));
+    if (cache_dir) {
+        fprintf(info, "\n");
+        token_cache_print_stats(&cache, info);
+    }
+    INSTRUMENT_REPORT(instrument_token_name);
 
     atom_table_destroy(atoms);
-    array_free(tokens, system_allocator);
+    array_free(tokens, &token_allocator);
+    source_file_close(&source);
     
     return 0;
 }
@@ -0,0 +1,34 @@
+#include "source_file.h"
+#include "foundation/atom.h"
+#include "foundation/os_helper.h"
+
+bool source_file_open(Source_File *file, const char *path)
+{
+    uint64_t size = 0;
+    const uint8_t *data = os_map_file(path, &size);
+    if (data == 0) {
+        printf("Unable to read file: '%s'\n", path);
+        return false;
+    }
+
+    if (size > UINT32_MAX) {
+        printf("File is too large for token spans: '%s'\n", path);
+        os_unmap_file(data, size);
+        return false;
+    }
+
+    *file = (Source_File) { .path = path, .data = data, .size = size };
+    return true;
+}
+
+void source_file_close(Source_File *file)
+{
+    if (file->data)
+        os_unmap_file(file->data, file->size);
+    *file = (Source_File) { 0 };
+}
+
+Atom *source_file_atom(const Source_File *file, const Token *token, Atom_Table *atoms)
+{
+    return atom_add(atoms, (const char *)file->data + token->span.offset, token->span.length);
+}
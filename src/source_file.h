@@ -0,0 +1,34 @@
+#pragma once
+#include "foundation/basic.h"
+#include "lexer.h"
+
+struct Atom;
+struct Atom_Table;
+
+//
+// A source file kept mapped for as long as tokens point into it
+//
+// Tokens lexed with `lexer_read_source` store identifiers and strings as spans of `data` instead of
+// atom ids, so nothing is copied or hashed while lexing. Consumers that only look at the text read it
+// in place, the ones that need an atom intern it when they ask for it.
+//
+typedef struct Source_File {
+    const char *path;
+    const uint8_t *data;
+    uint64_t size;
+} Source_File;
+
+// Map the file at `path`, returns false if it can't be read or is too large for 32 bit spans
+bool source_file_open(Source_File *file, const char *path);
+// Tokens lexed from the file are invalid afterwards
+void source_file_close(Source_File *file);
+
+// Text of an identifier or string token lexed from `file`, not zero terminated
+static inline String8 source_file_text(const Source_File *file, const Token *token)
+{
+    return (String8) { .len = token->span.length, .data = (uint8_t *)file->data + token->span.offset };
+}
+
+// Intern the text of an identifier or string token lexed from `file` into `atoms`, returns 0 if the
+// table is full
+struct Atom *source_file_atom(const Source_File *file, const Token *token, struct Atom_Table *atoms);
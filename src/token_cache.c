@@ -0,0 +1,218 @@
+#include "token_cache.h"
+#include "foundation/allocator.h"
+#include "foundation/array.h"
+#include "foundation/atom.h"
+#include "foundation/atomic.h"
+#include "foundation/flat_hash.h"
+#include "foundation/murmur_hash64.h"
+#include "foundation/os_helper.h"
+
+#include <string.h>
+
+// Tokens are written through a buffer of this many records
+#define TOKEN_CACHE_WRITE_BATCH 1024
+
+// Makes temporary file names unique between threads storing at the same time
+static volatile uint64_t token_cache__temp_counter;
+
+static inline bool token_cache__has_name(Token_Type type)
+{
+    return type == TOKEN_IDENTIFIER || type == TOKEN_STRING;
+}
+
+uint64_t token_cache_hash(const void *data, uint64_t size)
+{
+    // Murmur takes 32 bit lengths, larger sources are hashed in pieces chained through the seed
+    const uint8_t *p = data;
+    uint64_t hash = size;
+    do {
+        uint32_t n = size > GB(1) ? (uint32_t)GB(1) : (uint32_t)size;
+        hash = murmur_hash64a(p, n, hash);
+        p += n;
+        size -= n;
+    } while (size);
+    return hash;
+}
+
+static void token_cache__path(const Token_Cache *cache, uint64_t hash, char *buf, uint64_t buf_size)
+{
+    snprintf(buf, buf_size, "%s/%016llx.tokens", cache->dir, (unsigned long long)hash);
+}
+
+// Returns false if the file isn't a complete cache entry for this source
+static bool token_cache__validate(const uint8_t *data, uint64_t file_size, uint64_t hash, uint64_t size)
+{
+    if (file_size < sizeof(Token_Cache_Header))
+        return false;
+    const Token_Cache_Header *header = (const Token_Cache_Header *)data;
+    if (header->magic != TOKEN_CACHE_MAGIC || header->version != TOKEN_CACHE_VERSION ||
+        header->record_size != sizeof(Token_Cache_Record) || header->source_hash != hash || header->source_size != size)
+        return false;
+
+    // Each part is checked against what's left so corrupt counts can't overflow the sum
+    uint64_t left = file_size - sizeof(Token_Cache_Header);
+    if (header->num_tokens > left / sizeof(Token_Cache_Record))
+        return false;
+    left -= header->num_tokens * sizeof(Token_Cache_Record);
+    if (header->num_atoms > left / sizeof(uint32_t))
+        return false;
+    left -= (uint64_t)header->num_atoms * sizeof(uint32_t);
+    return header->string_bytes == left;
+}
+
+bool token_cache_load(Token_Cache *cache, uint64_t hash, uint64_t size, Token **tokens,
+    Atom_Table *atoms, Allocator *allocator)
+{
+    char path[4096];
+    token_cache__path(cache, hash, path, sizeof(path));
+
+    uint64_t file_size = 0;
+    const uint8_t *data = os_map_file(path, &file_size);
+    if (data == 0 || !token_cache__validate(data, file_size, hash, size)) {
+        if (data)
+            os_unmap_file(data, file_size);
+        atomic_add_u64(&cache->misses, 1);
+        return false;
+    }
+
+    const Token_Cache_Header *header = (const Token_Cache_Header *)data;
+    const Token_Cache_Record *records = (const Token_Cache_Record *)(header + 1);
+    const uint32_t *atom_ends = (const uint32_t *)(records + header->num_tokens);
+    const char *strings = (const char *)(atom_ends + header->num_atoms);
+
+    // Local atom index -> id in `atoms`
+    uint32_t *ids = 0;
+    array_ensure(ids, header->num_atoms, system_allocator);
+    bool ok = true;
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < header->num_atoms && ok; ++i) {
+        uint32_t end = atom_ends[i];
+        Atom *atom = end >= start && end <= header->string_bytes ? atom_add(atoms, strings + start, end - start) : 0;
+        ok = atom != 0;
+        array_push(ids, ok ? atom->id : 0, system_allocator);
+        start = end;
+    }
+
+    if (ok) {
+        array_reset(*tokens);
+        array_ensure(*tokens, header->num_tokens, allocator);
+        for (uint64_t i = 0; i < header->num_tokens; ++i) {
+            const Token_Cache_Record *r = &records[i];
+            Token token = {
+                .type = (Token_Type)r->type,
+                .l0 = r->l0,
+                .c0 = r->c0,
+                .l1 = r->l1,
+                .c1 = r->c1,
+                .int_value = r->payload,
+            };
+            if (token_cache__has_name(token.type)) {
+                if (r->payload >= header->num_atoms) {
+                    ok = false;
+                    break;
+                }
+                token.name = ids[r->payload];
+            }
+            (*tokens)[i] = token;
+        }
+        if (ok)
+            array_header(*tokens)->size = header->num_tokens;
+    }
+
+    array_free(ids, system_allocator);
+    os_unmap_file(data, file_size);
+    atomic_add_u64(ok ? &cache->hits : &cache->misses, 1);
+    return ok;
+}
+
+bool token_cache_store(Token_Cache *cache, uint64_t hash, uint64_t size, const Token *tokens, uint64_t num_tokens,
+    const Atom_Table *atoms)
+{
+    char path[4096];
+    char temp_path[4096 + 64];
+    token_cache__path(cache, hash, path, sizeof(path));
+    // Written next to the final file and renamed over it, readers never see half a file
+    snprintf(temp_path, sizeof(temp_path), "%s.%llx.%llx.tmp", path,
+        (unsigned long long)os_time_now(), (unsigned long long)atomic_add_u64(&token_cache__temp_counter, 1));
+
+    FILE *f = os_create_directory(cache->dir) ? fopen(temp_path, "wb") : 0;
+    if (f == 0) {
+        atomic_add_u64(&cache->store_failures, 1);
+        return false;
+    }
+
+    // Live atom id + 1 -> local index, local atoms are numbered in order of first use
+    Flat_Hash local = { 0 };
+    uint32_t *used = 0;
+    uint32_t *atom_ends = 0;
+    uint64_t string_bytes = 0;
+    for (uint64_t i = 0; i < num_tokens; ++i) {
+        if (!token_cache__has_name(tokens[i].type))
+            continue;
+        uint64_t *slot = flat_hash_add_reference(&local, (uint64_t)tokens[i].name + 1, system_allocator);
+        if (*slot)
+            continue;
+        *slot = array_size(used) + 1;
+        array_push(used, tokens[i].name, system_allocator);
+        string_bytes += atom_get(atoms, tokens[i].name)->str.len;
+        array_push(atom_ends, (uint32_t)string_bytes, system_allocator);
+    }
+
+    Token_Cache_Header header = {
+        .magic = TOKEN_CACHE_MAGIC,
+        .version = TOKEN_CACHE_VERSION,
+        .source_hash = hash,
+        .source_size = size,
+        .num_tokens = num_tokens,
+        .num_atoms = (uint32_t)array_size(used),
+        .record_size = sizeof(Token_Cache_Record),
+        .string_bytes = string_bytes,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    Token_Cache_Record *batch = malloc(TOKEN_CACHE_WRITE_BATCH * sizeof(Token_Cache_Record));
+    for (uint64_t i = 0; i < num_tokens && ok; i += TOKEN_CACHE_WRITE_BATCH) {
+        uint64_t n = num_tokens - i < TOKEN_CACHE_WRITE_BATCH ? num_tokens - i : TOKEN_CACHE_WRITE_BATCH;
+        for (uint64_t j = 0; j < n; ++j) {
+            const Token *t = &tokens[i + j];
+            batch[j] = (Token_Cache_Record) {
+                .type = t->type,
+                .l0 = t->l0,
+                .c0 = t->c0,
+                .l1 = t->l1,
+                .c1 = t->c1,
+                .payload = token_cache__has_name(t->type) ? flat_hash_get(&local, (uint64_t)t->name + 1) - 1
+                    : t->int_value,
+            };
+        }
+        ok = fwrite(batch, sizeof(Token_Cache_Record), n, f) == n;
+    }
+    free(batch);
+
+    if (ok && array_size(atom_ends))
+        ok = fwrite(atom_ends, sizeof(uint32_t), array_size(atom_ends), f) == array_size(atom_ends);
+    for (uint32_t *it = used; it != array_end(used) && ok; ++it) {
+        String8 str = atom_get(atoms, *it)->str;
+        ok = str.len == 0 || fwrite(str.data, 1, str.len, f) == str.len;
+    }
+
+    ok = fclose(f) == 0 && ok;
+    ok = ok && os_replace_file(temp_path, path);
+    if (!ok)
+        remove(temp_path);
+
+    flat_hash_free(&local, system_allocator);
+    array_free(used, system_allocator);
+    array_free(atom_ends, system_allocator);
+    atomic_add_u64(ok ? &cache->stores : &cache->store_failures, 1);
+    return ok;
+}
+
+void token_cache_print_stats(const Token_Cache *cache, FILE *f)
+{
+    uint64_t hits = cache->hits;
+    uint64_t misses = cache->misses;
+    fprintf(f, "Token cache '%s': %zu hits, %zu misses (%.1f%% hit rate), %zu stored, %zu failed to store\n",
+        cache->dir, hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+        cache->stores, cache->store_failures);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "foundation/basic.h"
+#include "lexer.h"
+
+struct Atom_Table;
+struct Allocator;
+
+//
+// On-disk cache of token streams, keyed by a hash of the source bytes
+//
+// Every lexed file is stored as `<dir>/<hash>.tokens`: a header, a fixed size record per token,
+// and the strings of the atoms they reference. Token names in the file index that string list
+// instead of a live Atom_Table, so loading maps the file, copies the tokens out and rebinds
+// their names by adding the strings to the table it's loaded into. Files from another version of
+// the lexer, or that don't match the source size and hash, are ignored and written again.
+//
+// The counters are updated atomically, one cache can be shared by several lexing threads.
+//
+
+#define TOKEN_CACHE_MAGIC 0x4354584cu // "LXTC"
+// Bump whenever the lexer output or the file layout changes
+#define TOKEN_CACHE_VERSION 6
+
+typedef struct Token_Cache_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t num_tokens;
+    uint32_t num_atoms;
+    uint32_t record_size;
+    uint64_t string_bytes;
+    // Followed by Token_Cache_Record records[num_tokens], uint32_t atom_ends[num_atoms] (end of each
+    // atom's string in the string data) and char strings[string_bytes]
+} Token_Cache_Header;
+
+// A Token as it is stored, every byte is written so the same source always gives the same file
+typedef struct Token_Cache_Record {
+    uint32_t type;
+    int32_t l0, c0, l1, c1;
+    uint32_t reserved;
+    // Local atom index of identifiers and strings, the payload bits of anything else
+    uint64_t payload;
+} Token_Cache_Record;
+
+_Static_assert(sizeof(Token_Cache_Record) == 32, "Token_Cache_Record has padding");
+
+typedef struct Token_Cache {
+    // Directory the cache files are kept in, created on the first store
+    const char *dir;
+    volatile uint64_t hits;
+    volatile uint64_t misses;
+    volatile uint64_t stores;
+    volatile uint64_t store_failures;
+} Token_Cache;
+
+// Key of `size` bytes of source
+uint64_t token_cache_hash(const void *data, uint64_t size);
+
+// Replace `tokens` with the cached tokens of the source with this hash and size, their names bound
+// to `atoms`. Returns false on a miss, `tokens` is left untouched unless the entry is corrupt.
+bool token_cache_load(Token_Cache *cache, uint64_t hash, uint64_t size, Token **tokens,
+    struct Atom_Table *atoms, struct Allocator *allocator);
+
+// Write `num_tokens` tokens lexed from the source with this hash and size, names resolved in `atoms`
+bool token_cache_store(Token_Cache *cache, uint64_t hash, uint64_t size, const Token *tokens, uint64_t num_tokens,
+    const struct Atom_Table *atoms);
+
+void token_cache_print_stats(const Token_Cache *cache, FILE *f);
@@ -0,0 +1,220 @@
+#pragma once
+#include "foundation/basic.h"
+#include "foundation/array.h"
+#include "lexer.h"
+#include "token_stream.h"
+
+//
+// Packed token stream
+// A byte encoding of the same tokens as Token_Stream that's built while lexing and read back
+// sequentially, at about a fifth of the size. Every token is
+//
+//   type    One byte, the `token_type_code`. 0xff, which is never a code, is followed by the type as a
+//           varint and is used for a token that doesn't have the usual length of its type.
+//   gap     Varint, bytes between the end of the previous token and the start of this one
+//   length  Varint, left out for types that always have the same length (characters, operators, keywords)
+//   payload Varint, only for types with a payload: the atom id of identifiers and strings, the int bits
+//           of numbers
+//
+// Varints are LEB128, seven bits per byte with the high bit set on all but the last byte.
+// Offsets only exist as a running sum, so every TOKEN_PACK_BLOCK tokens a block records where its
+// first token is in `data` and the offset the gap of that token is relative to. Seeking to a token
+// decodes from the start of its block.
+//
+
+#define TOKEN_PACK_BLOCK 128
+#define TOKEN_PACK_ESCAPE TOKEN_CODE_NONE
+// Escape byte, then type, gap, length and payload varints
+#define TOKEN_PACK_MAX_TOKEN (1 + 5 + 5 + 5 + 10)
+
+typedef struct Token_Pack_Block {
+    // Where the first token of the block starts in `data`
+    uint64_t byte;
+    // End of the token before it
+    uint32_t offset;
+} Token_Pack_Block;
+
+typedef struct Token_Pack {
+    uint8_t *data;
+    Token_Pack_Block *blocks;
+    uint64_t count;
+    // End of the last token
+    uint32_t end;
+} Token_Pack;
+
+static inline uint64_t token_pack_size(const Token_Pack *p)
+{
+    return p->count;
+}
+
+static inline uint64_t token_pack_bytes(const Token_Pack *p)
+{
+    return array_size(p->data) + array_size(p->blocks) * sizeof(*p->blocks);
+}
+
+// Length every token of `type` has, or 0 if it varies
+static inline uint32_t token_pack__fixed_length(Token_Type type)
+{
+    if (type < 256)
+        return 1;
+    if (type >= TOKEN_OPERATOR_FIRST && type < TOKEN_OPERATOR_LAST)
+        return operator_lengths[type - TOKEN_OPERATOR_FIRST];
+    if (type >= TOKEN_KEYWORD_FIRST && type < TOKEN_KEYWORD_LAST)
+        return keyword_lengths[type - TOKEN_KEYWORD_FIRST];
+    return 0;
+}
+
+static inline uint8_t *token_pack__write_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline uint64_t token_pack__read_varint(const uint8_t **p)
+{
+    const uint8_t *s = *p;
+    uint64_t v = *s++;
+    if (v >= 0x80) {
+        v &= 0x7f;
+        uint32_t shift = 7;
+        uint8_t b;
+        do {
+            b = *s++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+    }
+    *p = s;
+    return v;
+}
+
+static inline void token_pack_push(Token_Pack *p, Token_Type type, uint32_t offset, uint32_t length,
+    Token_Payload payload, struct Allocator *a)
+{
+    if (p->count % TOKEN_PACK_BLOCK == 0) {
+        Token_Pack_Block block = { .byte = array_size(p->data), .offset = p->end };
+        array_push(p->blocks, block, a);
+    }
+    array_ensure(p->data, array_size(p->data) + TOKEN_PACK_MAX_TOKEN, a);
+    uint8_t *start = p->data + array_size(p->data);
+    uint8_t *out = start;
+
+    uint8_t code = token_type_code(type);
+    uint32_t fixed = token_pack__fixed_length(type);
+    bool has_length = fixed == 0;
+    if (code != TOKEN_CODE_NONE && (fixed == 0 || fixed == length)) {
+        *out++ = code;
+    } else {
+        *out++ = TOKEN_PACK_ESCAPE;
+        out = token_pack__write_varint(out, type);
+        has_length = true;
+    }
+    out = token_pack__write_varint(out, offset - p->end);
+    if (has_length)
+        out = token_pack__write_varint(out, length);
+    if (type == TOKEN_NUMBER)
+        out = token_pack__write_varint(out, payload.int_value);
+    else if (token_type_has_payload(type))
+        out = token_pack__write_varint(out, payload.name);
+
+    array_header(p->data)->size += out - start;
+    p->end = offset + length;
+    p->count++;
+}
+
+// Make room for `n` tokens, most take 2-4 bytes
+static inline void token_pack_reserve(Token_Pack *p, uint64_t n, struct Allocator *a)
+{
+    array_ensure(p->data, n * 4, a);
+    array_ensure(p->blocks, (n + TOKEN_PACK_BLOCK - 1) / TOKEN_PACK_BLOCK, a);
+}
+
+static inline void token_pack_reset(Token_Pack *p)
+{
+    array_reset(p->data);
+    array_reset(p->blocks);
+    p->count = 0;
+    p->end = 0;
+}
+
+static inline void token_pack_free(Token_Pack *p, struct Allocator *a)
+{
+    array_free(p->data, a);
+    array_free(p->blocks, a);
+    p->count = 0;
+    p->end = 0;
+}
+
+//
+// Decoding
+//
+// for (Token_Pack_Iterator it = token_pack_iterator(p, 0); token_pack_iterator_valid(&it); token_pack_iterator_next(&it))
+//
+// The current token is in `type`, `offset`, `length` and `payload`, which is zero for types without one.
+//
+
+typedef struct Token_Pack_Iterator {
+    const Token_Pack *pack;
+    // Encoding of the token after the current one
+    const uint8_t *next;
+    uint64_t index;
+    Token_Type type;
+    uint32_t offset;
+    uint32_t length;
+    Token_Payload payload;
+} Token_Pack_Iterator;
+
+static inline void token_pack__decode(Token_Pack_Iterator *it)
+{
+    const uint8_t *s = it->next;
+    uint32_t end = it->offset + it->length;
+    uint8_t code = *s++;
+    Token_Type type;
+    uint32_t length;
+    if (code < 128) {
+        type = (Token_Type)code;
+        length = 1;
+    } else if (code != TOKEN_PACK_ESCAPE) {
+        type = token_code_type(code);
+        length = token_pack__fixed_length(type);
+    } else {
+        type = (Token_Type)token_pack__read_varint(&s);
+        length = 0;
+    }
+    it->offset = end + (uint32_t)token_pack__read_varint(&s);
+    if (length == 0)
+        length = (uint32_t)token_pack__read_varint(&s);
+    it->payload.int_value = token_type_has_payload(type) ? token_pack__read_varint(&s) : 0;
+    it->type = type;
+    it->length = length;
+    it->next = s;
+}
+
+// Iterate from token `first`, which is found through its block
+static inline Token_Pack_Iterator token_pack_iterator(const Token_Pack *p, uint64_t first)
+{
+    Token_Pack_Iterator it = { .pack = p, .index = first };
+    if (first >= p->count)
+        return it;
+    const Token_Pack_Block *block = &p->blocks[first / TOKEN_PACK_BLOCK];
+    it.next = p->data + block->byte;
+    it.offset = block->offset;
+    for (uint64_t i = first / TOKEN_PACK_BLOCK * TOKEN_PACK_BLOCK; i <= first; ++i)
+        token_pack__decode(&it);
+    return it;
+}
+
+static inline bool token_pack_iterator_valid(const Token_Pack_Iterator *it)
+{
+    return it->index < it->pack->count;
+}
+
+static inline void token_pack_iterator_next(Token_Pack_Iterator *it)
+{
+    if (++it->index < it->pack->count)
+        token_pack__decode(it);
+}
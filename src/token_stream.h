@@ -0,0 +1,404 @@
+#pragma once
+#include "foundation/basic.h"
+#include "foundation/array.h"
+#include "foundation/bits.h"
+#include "lexer.h"
+
+//
+// Compact structure-of-arrays token storage
+// Every token costs a 1 byte type code (see `token_type_code`), a 32 bit start offset and a 1 byte
+// length. Lengths of TOKEN_STREAM_LONG_LENGTH and more are kept in a short side list instead.
+// Identifiers and strings additionally store their 4 byte atom id and numbers their 8 byte value,
+// each in a separate array that's located through a Token_Rank, so streams are always lexed with an
+// atom table. Ordinary C source comes to about 9 bytes per token, against 32 for a Token.
+// Offsets are 32 bit, so a single stream covers sources up to 4GB.
+//
+
+typedef union Token_Payload {
+    uint32_t name;        // Atom id of TOKEN_IDENTIFIER and TOKEN_STRING
+    Token_Span span;      // Or their text, when lexed without interning
+    uint64_t int_value;
+    double float_value;
+} Token_Payload;
+
+// A bit per token that's set if it has an entry in a side array, and the number of set bits before
+// every 64 tokens. The entry of a token is at the number of set bits before it.
+typedef struct Token_Rank {
+    uint64_t *bits;
+    uint32_t *base;
+} Token_Rank;
+
+#define TOKEN_STREAM_LONG_LENGTH 255
+
+typedef struct Token_Long_Length {
+    uint32_t index;
+    uint32_t length;
+} Token_Long_Length;
+
+typedef struct Token_Stream {
+    uint8_t *types;
+    uint32_t *offsets;
+    // Up to TOKEN_STREAM_LONG_LENGTH, which means the length is in `long_lengths`
+    uint8_t *lengths;
+    // Ordered by index
+    Token_Long_Length *long_lengths;
+    uint32_t *names;
+    uint64_t *numbers;
+    Token_Rank name_rank;
+    Token_Rank number_rank;
+    // Offsets from token `shift_from` on are stored without `shift`, which a splice adds to instead
+    // of moving every later offset. Wraps like the offsets do.
+    uint64_t shift_from;
+    uint32_t shift;
+} Token_Stream;
+
+static inline bool token_type_has_payload(Token_Type type)
+{
+    return type == TOKEN_IDENTIFIER || type == TOKEN_NUMBER || type == TOKEN_STRING;
+}
+
+static inline bool token_type_has_name(Token_Type type)
+{
+    return type == TOKEN_IDENTIFIER || type == TOKEN_STRING;
+}
+
+//
+// Token_Rank
+//
+
+static inline void token_rank__push(Token_Rank *r, uint64_t i, bool set, struct Allocator *a)
+{
+    if (i % 64 == 0) {
+        uint64_t b = i / 64;
+        uint32_t base = b ? r->base[b - 1] + bits_popcount64(r->bits[b - 1]) : 0;
+        array_push(r->bits, 0, a);
+        array_push(r->base, base, a);
+    }
+    r->bits[i / 64] |= (uint64_t)set << (i % 64);
+}
+
+static inline bool token_rank__has(const Token_Rank *r, uint64_t i)
+{
+    return (r->bits[i / 64] >> (i % 64)) & 1;
+}
+
+// Number of set bits before `i`, `count` is the number of entries for `i` at or past the last token
+static inline uint64_t token_rank__get(const Token_Rank *r, uint64_t i, uint64_t size, uint64_t count)
+{
+    if (i >= size)
+        return count;
+    return r->base[i / 64] + bits_popcount64(r->bits[i / 64] & ((1ULL << (i % 64)) - 1));
+}
+
+// `count` bits from bit `pos` on, `count` is at most 64
+static inline uint64_t token_rank__read(const uint64_t *bits, uint64_t pos, uint64_t count)
+{
+    uint64_t w = pos / 64, shift = pos % 64;
+    uint64_t v = bits[w] >> shift;
+    if (shift && shift + count > 64)
+        v |= bits[w + 1] << (64 - shift);
+    return count < 64 ? v & ((1ULL << count) - 1) : v;
+}
+
+// Set the `count` bits from bit `pos` on to `v`, they have to be clear
+static inline void token_rank__write(uint64_t *bits, uint64_t pos, uint64_t v, uint64_t count)
+{
+    uint64_t w = pos / 64, shift = pos % 64;
+    bits[w] |= v << shift;
+    if (shift && shift + count > 64)
+        bits[w + 1] |= v >> (64 - shift);
+}
+
+// Replace the bits of tokens [at, at + remove) with the `n` bits of `src`, a word at a time. Bits after
+// them move by `n - remove`, which needn't be a whole word, so they're copied out first.
+static inline void token_rank__splice(Token_Rank *r, uint64_t size, uint64_t at, uint64_t remove,
+    const Token_Rank *src, uint64_t n, struct Allocator *a)
+{
+    uint64_t tail_start = at + remove;
+    uint64_t tail = size - tail_start;
+    uint64_t *moved = 0;
+    for (uint64_t p = 0; p < tail; p += 64) {
+        uint64_t count = tail - p < 64 ? tail - p : 64;
+        array_push(moved, token_rank__read(r->bits, tail_start + p, count), a);
+    }
+
+    uint64_t words = (size - remove + n + 63) / 64;
+    uint64_t block = at / 64;
+    if (words == 0) {
+        array_reset(r->bits);
+        array_reset(r->base);
+        array_free(moved, a);
+        return;
+    }
+    array_ensure(r->bits, words, a);
+    array_ensure(r->base, words, a);
+    array_header(r->bits)->size = words;
+    array_header(r->base)->size = words;
+
+    r->bits[block] &= (1ULL << (at % 64)) - 1;
+    if (words > block + 1)
+        memset(r->bits + block + 1, 0, (words - block - 1) * sizeof(*r->bits));
+    for (uint64_t p = 0; p < n; p += 64) {
+        uint64_t count = n - p < 64 ? n - p : 64;
+        token_rank__write(r->bits, at + p, token_rank__read(src->bits, p, count), count);
+    }
+    for (uint64_t p = 0; p < tail; p += 64) {
+        uint64_t count = tail - p < 64 ? tail - p : 64;
+        token_rank__write(r->bits, at + n + p, moved[p / 64], count);
+    }
+
+    for (uint64_t b = block; b < words; ++b)
+        r->base[b] = b ? r->base[b - 1] + bits_popcount64(r->bits[b - 1]) : 0;
+    array_free(moved, a);
+}
+
+static inline uint64_t token_rank__bytes(const Token_Rank *r)
+{
+    return array_size(r->bits) * sizeof(*r->bits) + array_size(r->base) * sizeof(*r->base);
+}
+
+static inline void token_rank__free(Token_Rank *r, struct Allocator *a)
+{
+    array_free(r->bits, a);
+    array_free(r->base, a);
+}
+
+//
+// Token_Stream
+//
+
+static inline uint64_t token_stream_size(const Token_Stream *s)
+{
+    return array_size(s->types);
+}
+
+static inline Token_Type token_stream_type(const Token_Stream *s, uint64_t i)
+{
+    return token_code_type(s->types[i]);
+}
+
+static inline uint32_t token_stream_offset(const Token_Stream *s, uint64_t i)
+{
+    return s->offsets[i] + (i >= s->shift_from ? s->shift : 0);
+}
+
+// Position of the first entry of `long_lengths` with an index of at least `i`
+static inline uint64_t token_stream__long_length_at(const Token_Stream *s, uint64_t i)
+{
+    uint64_t first = 0, count = array_size(s->long_lengths);
+    while (count > 0) {
+        uint64_t half = count / 2;
+        if (s->long_lengths[first + half].index < i) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
+static inline uint32_t token_stream_length(const Token_Stream *s, uint64_t i)
+{
+    if (s->lengths[i] != TOKEN_STREAM_LONG_LENGTH)
+        return s->lengths[i];
+    return s->long_lengths[token_stream__long_length_at(s, i)].length;
+}
+
+// Returns the payload of token `i`, which is zero if its type doesn't carry one
+static inline Token_Payload token_stream_payload(const Token_Stream *s, uint64_t i)
+{
+    Token_Payload payload = { 0 };
+    if (token_rank__has(&s->name_rank, i))
+        payload.name = s->names[token_rank__get(&s->name_rank, i, token_stream_size(s), array_size(s->names))];
+    else if (token_rank__has(&s->number_rank, i))
+        payload.int_value = s->numbers[token_rank__get(&s->number_rank, i, token_stream_size(s), array_size(s->numbers))];
+    return payload;
+}
+
+static inline uint64_t token_stream_bytes(const Token_Stream *s)
+{
+    return array_size(s->types) * sizeof(*s->types)
+        + array_size(s->offsets) * sizeof(*s->offsets)
+        + array_size(s->lengths) * sizeof(*s->lengths)
+        + array_size(s->long_lengths) * sizeof(*s->long_lengths)
+        + array_size(s->names) * sizeof(*s->names)
+        + array_size(s->numbers) * sizeof(*s->numbers)
+        + token_rank__bytes(&s->name_rank)
+        + token_rank__bytes(&s->number_rank);
+}
+
+static inline void token_stream_push(Token_Stream *s, Token_Type type, uint32_t offset, uint32_t length,
+    Token_Payload payload, struct Allocator *a)
+{
+    uint64_t i = token_stream_size(s);
+    array_push(s->types, token_type_code(type), a);
+    array_push(s->offsets, offset - s->shift, a);
+    if (length >= TOKEN_STREAM_LONG_LENGTH) {
+        Token_Long_Length long_length = { .index = (uint32_t)i, .length = length };
+        array_push(s->long_lengths, long_length, a);
+        array_push(s->lengths, TOKEN_STREAM_LONG_LENGTH, a);
+    } else {
+        array_push(s->lengths, (uint8_t)length, a);
+    }
+
+    token_rank__push(&s->name_rank, i, token_type_has_name(type), a);
+    token_rank__push(&s->number_rank, i, type == TOKEN_NUMBER, a);
+    if (token_type_has_name(type))
+        array_push(s->names, payload.name, a);
+    else if (type == TOKEN_NUMBER)
+        array_push(s->numbers, payload.int_value, a);
+}
+
+// Replace the tokens [at, at + remove) with all tokens of `src`, and move the offsets of the tokens
+// after them by `delta`. Costs the moves of the arrays, offsets are only touched between the edit
+// and the previous one.
+static inline void token_stream_splice(Token_Stream *s, uint64_t at, uint64_t remove, const Token_Stream *src,
+    int64_t delta, struct Allocator *a)
+{
+    uint64_t old_size = token_stream_size(s);
+    uint64_t n = token_stream_size(src);
+    uint64_t name_at = token_rank__get(&s->name_rank, at, old_size, array_size(s->names));
+    uint64_t name_remove = token_rank__get(&s->name_rank, at + remove, old_size, array_size(s->names)) - name_at;
+    uint64_t number_at = token_rank__get(&s->number_rank, at, old_size, array_size(s->numbers));
+    uint64_t number_remove = token_rank__get(&s->number_rank, at + remove, old_size, array_size(s->numbers))
+        - number_at;
+    uint64_t long_at = token_stream__long_length_at(s, at);
+    uint64_t long_remove = token_stream__long_length_at(s, at + remove) - long_at;
+
+    // Move the start of the pending shift to the end of the edit, so it can take `delta` as well
+    for (uint64_t i = s->shift_from; i < at; ++i)
+        s->offsets[i] += s->shift;
+    for (uint64_t i = at + remove; i < s->shift_from; ++i)
+        s->offsets[i] -= s->shift;
+
+    token_rank__splice(&s->name_rank, old_size, at, remove, &src->name_rank, n, a);
+    token_rank__splice(&s->number_rank, old_size, at, remove, &src->number_rank, n, a);
+
+    array_splice(s->types, at, remove, src->types, n, a);
+    array_splice(s->offsets, at, remove, src->offsets, n, a);
+    array_splice(s->lengths, at, remove, src->lengths, n, a);
+    array_splice(s->names, name_at, name_remove, src->names, array_size(src->names), a);
+    array_splice(s->numbers, number_at, number_remove, src->numbers, array_size(src->numbers), a);
+    array_splice(s->long_lengths, long_at, long_remove, src->long_lengths, array_size(src->long_lengths), a);
+
+    for (uint64_t i = src->shift_from; src->shift && i < n; ++i)
+        s->offsets[at + i] += src->shift;
+    s->shift_from = at + n;
+    s->shift += (uint32_t)delta;
+
+    // Indices of long lengths are relative to the token they belong to
+    uint64_t long_inserted = array_size(src->long_lengths);
+    for (uint64_t i = long_at; i < long_at + long_inserted; ++i)
+        s->long_lengths[i].index += (uint32_t)at;
+    for (uint64_t i = long_at + long_inserted; i < array_size(s->long_lengths); ++i)
+        s->long_lengths[i].index = (uint32_t)(s->long_lengths[i].index + n - remove);
+}
+
+// Make room for `n` tokens so pushing that many doesn't grow the arrays, about a third of all tokens
+// are identifiers and strings, much fewer are numbers
+static inline void token_stream_reserve(Token_Stream *s, uint64_t n, struct Allocator *a)
+{
+    array_ensure(s->types, n, a);
+    array_ensure(s->offsets, n, a);
+    array_ensure(s->lengths, n, a);
+    array_ensure(s->names, n / 2, a);
+    array_ensure(s->numbers, n / 8, a);
+    array_ensure(s->name_rank.bits, (n + 63) / 64, a);
+    array_ensure(s->name_rank.base, (n + 63) / 64, a);
+    array_ensure(s->number_rank.bits, (n + 63) / 64, a);
+    array_ensure(s->number_rank.base, (n + 63) / 64, a);
+}
+
+static inline void token_stream_reset(Token_Stream *s)
+{
+    array_reset(s->types);
+    array_reset(s->offsets);
+    array_reset(s->lengths);
+    array_reset(s->long_lengths);
+    array_reset(s->names);
+    array_reset(s->numbers);
+    array_reset(s->name_rank.bits);
+    array_reset(s->name_rank.base);
+    array_reset(s->number_rank.bits);
+    array_reset(s->number_rank.base);
+    s->shift_from = 0;
+    s->shift = 0;
+}
+
+static inline void token_stream_free(Token_Stream *s, struct Allocator *a)
+{
+    array_free(s->types, a);
+    array_free(s->offsets, a);
+    array_free(s->lengths, a);
+    array_free(s->long_lengths, a);
+    array_free(s->names, a);
+    array_free(s->numbers, a);
+    token_rank__free(&s->name_rank, a);
+    token_rank__free(&s->number_rank, a);
+    s->shift_from = 0;
+    s->shift = 0;
+}
+
+//
+// Sequential iteration, avoids the rank lookups of `token_stream_payload` and the search of
+// `token_stream_length`
+//
+// for (Token_Iterator it = token_iterator(s); token_iterator_valid(&it); token_iterator_next(&it))
+//
+
+typedef struct Token_Iterator {
+    const Token_Stream *stream;
+    uint64_t index;
+    uint64_t name;
+    uint64_t number;
+    uint64_t long_length;
+} Token_Iterator;
+
+static inline Token_Iterator token_iterator(const Token_Stream *s)
+{
+    return (Token_Iterator) { .stream = s };
+}
+
+static inline bool token_iterator_valid(const Token_Iterator *it)
+{
+    return it->index < token_stream_size(it->stream);
+}
+
+static inline Token_Type token_iterator_type(const Token_Iterator *it)
+{
+    return token_code_type(it->stream->types[it->index]);
+}
+
+static inline uint32_t token_iterator_offset(const Token_Iterator *it)
+{
+    return token_stream_offset(it->stream, it->index);
+}
+
+static inline uint32_t token_iterator_length(const Token_Iterator *it)
+{
+    uint8_t length = it->stream->lengths[it->index];
+    if (length != TOKEN_STREAM_LONG_LENGTH)
+        return length;
+    return it->stream->long_lengths[it->long_length].length;
+}
+
+static inline Token_Payload token_iterator_payload(const Token_Iterator *it)
+{
+    Token_Payload payload = { 0 };
+    Token_Type type = token_iterator_type(it);
+    if (token_type_has_name(type))
+        payload.name = it->stream->names[it->name];
+    else if (type == TOKEN_NUMBER)
+        payload.int_value = it->stream->numbers[it->number];
+    return payload;
+}
+
+static inline void token_iterator_next(Token_Iterator *it)
+{
+    Token_Type type = token_iterator_type(it);
+    it->name += token_type_has_name(type);
+    it->number += type == TOKEN_NUMBER;
+    it->long_length += it->stream->lengths[it->index] == TOKEN_STREAM_LONG_LENGTH;
+    it->index++;
+}
@@ -0,0 +1,330 @@
+#include "token_writer.h"
+#include "line_index.h"
+#include "source_file.h"
+#include "token_pack.h"
+#include "token_stream.h"
+#include "token_util.h"
+#include "foundation/allocator.h"
+#include "foundation/atom.h"
+#include "foundation/os_helper.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TOKEN_WRITER_BUFFER MB(1)
+// `%f` of the largest double has 309 digits before the point
+#define TOKEN_WRITER_MAX_FLOAT 320
+// Room for everything of a token but its text: positions, type name, dashes and a formatted number
+#define TOKEN_WRITER_MAX_FIXED (192 + TOKEN_WRITER_MAX_FLOAT)
+
+static void token_writer__flush(Token_Writer *w)
+{
+    if (w->used && !w->failed)
+        w->failed = fwrite(w->buf, 1, w->used, w->f) != w->used;
+    w->used = 0;
+}
+
+static inline char *token_writer__reserve(Token_Writer *w, uint64_t n)
+{
+    if (w->used + n > w->capacity)
+        token_writer__flush(w);
+    return w->buf + w->used;
+}
+
+static void token_writer__bytes(Token_Writer *w, const void *data, uint64_t n)
+{
+    if (w->used + n > w->capacity) {
+        token_writer__flush(w);
+        // Too large to be worth copying, goes out on its own
+        if (n > w->capacity) {
+            if (!w->failed)
+                w->failed = fwrite(data, 1, n, w->f) != n;
+            return;
+        }
+    }
+    memcpy(w->buf + w->used, data, n);
+    w->used += n;
+}
+
+static inline char *token_writer__str(char *p, const char *s)
+{
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+static inline char *token_writer__u64(char *p, uint64_t v)
+{
+    char digits[20];
+    uint32_t n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+static inline char *token_writer__i64(char *p, int64_t v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        return token_writer__u64(p, 0 - (uint64_t)v);
+    }
+    return token_writer__u64(p, (uint64_t)v);
+}
+
+static inline uint32_t token_writer__digits(int64_t v)
+{
+    uint32_t n = 1;
+    for (; v >= 10; v /= 10)
+        ++n;
+    return n;
+}
+
+// `%f`, which is all zeros for the subnormals integer literals look like as doubles
+static char *token_writer__float_fixed(char *p, double v)
+{
+    if (fabs(v) < 4.9e-7) {
+        if (signbit(v))
+            *p++ = '-';
+        return token_writer__str(p, "0.000000");
+    }
+    int n = snprintf(p, TOKEN_WRITER_MAX_FLOAT, "%f", v);
+    return p + (n > 0 ? n : 0);
+}
+
+static char *token_writer__float_json(char *p, double v)
+{
+    if (!isfinite(v))
+        return token_writer__str(p, "null");
+    if (v == 0 || fpclassify(v) == FP_SUBNORMAL)
+        return token_writer__str(p, "0");
+    return p + snprintf(p, 32, "%.17g", v);
+}
+
+// JSON string contents, the text is valid UTF-8 so only quotes, backslashes and control characters
+// need escaping
+static void token_writer__json_text(Token_Writer *w, const uint8_t *s, uint64_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint64_t run = 0;
+    for (uint64_t i = 0; i < len; ++i) {
+        uint8_t c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        token_writer__bytes(w, s + run, i - run);
+        char *p = token_writer__reserve(w, 6);
+        char *start = p;
+        *p++ = '\\';
+        if (c == '"' || c == '\\') {
+            *p++ = (char)c;
+        } else if (c == '\n') {
+            *p++ = 'n';
+        } else if (c == '\t') {
+            *p++ = 't';
+        } else if (c == '\r') {
+            *p++ = 'r';
+        } else {
+            p = token_writer__str(p, "u00");
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 15];
+        }
+        w->used += p - start;
+        run = i + 1;
+    }
+    token_writer__bytes(w, s + run, len - run);
+}
+
+static inline bool token_writer__has_text(Token_Type type)
+{
+    return type == TOKEN_IDENTIFIER || type == TOKEN_STRING;
+}
+
+// `pad` is the width the position and dashes are padded to, the human format without padding is < 0
+static void token_writer__token(Token_Writer *w, const Token *t, String8 text, int pad)
+{
+    char *p = token_writer__reserve(w, TOKEN_WRITER_MAX_FIXED);
+    char *start = p;
+
+    if (w->format == TOKEN_FORMAT_BINARY) {
+        uint32_t type = t->type;
+        int32_t pos[4] = { t->l0, t->c0, t->l1, t->c1 };
+        uint64_t payload = token_writer__has_text(t->type) ? text.len : t->int_value;
+        memcpy(p, &type, 4);
+        memcpy(p + 4, pos, 16);
+        memcpy(p + 20, &payload, 8);
+        w->used += TOKEN_BINARY_RECORD_SIZE;
+        if (token_writer__has_text(t->type))
+            token_writer__bytes(w, text.data, text.len);
+        return;
+    }
+
+    if (w->format == TOKEN_FORMAT_JSONL) {
+        p = token_writer__str(p, "{\"type\":\"");
+        w->used += p - start;
+        const char *name = token_type_name(*t);
+        token_writer__json_text(w, (const uint8_t *)name, strlen(name));
+        p = start = token_writer__reserve(w, TOKEN_WRITER_MAX_FIXED);
+        p = token_writer__str(p, "\",\"line\":");
+        p = token_writer__i64(p, (int64_t)t->l0 + 1);
+        p = token_writer__str(p, ",\"col\":");
+        p = token_writer__i64(p, t->c0);
+        p = token_writer__str(p, ",\"end_line\":");
+        p = token_writer__i64(p, (int64_t)t->l1 + 1);
+        p = token_writer__str(p, ",\"end_col\":");
+        p = token_writer__i64(p, t->c1);
+        if (t->type == TOKEN_NUMBER) {
+            p = token_writer__str(p, ",\"int\":");
+            p = token_writer__u64(p, t->int_value);
+            p = token_writer__str(p, ",\"float\":");
+            p = token_writer__float_json(p, t->float_value);
+        } else if (token_writer__has_text(t->type)) {
+            p = token_writer__str(p, ",\"text\":\"");
+            w->used += p - start;
+            token_writer__json_text(w, text.data, text.len);
+            p = start = token_writer__reserve(w, 4);
+            *p++ = '"';
+        }
+        *p++ = '}';
+        *p++ = '\n';
+        w->used += p - start;
+        return;
+    }
+
+    *p++ = '[';
+    p = token_writer__i64(p, (int64_t)t->l0 + 1);
+    *p++ = ',';
+    p = token_writer__i64(p, t->c0);
+    p = token_writer__str(p, "->");
+    p = token_writer__i64(p, (int64_t)t->l1 + 1);
+    *p++ = ',';
+    p = token_writer__i64(p, t->c1);
+    *p++ = ']';
+    *p++ = ' ';
+    if (pad >= 0) {
+        // Dashes up to `pad`, capped at 32. A position wider than `pad` got all 32, as it did when
+        // this was a printf precision.
+        int len = (int)(p - start) - 1;
+        int dashes = pad - len < 0 || pad - len > 32 ? 32 : pad - len;
+        memset(p, '-', dashes);
+        p += dashes;
+    }
+    p = token_writer__str(p, "-> ");
+    p = token_writer__str(p, token_type_name(*t));
+
+    if (t->type == TOKEN_NUMBER) {
+        p = token_writer__str(p, " <");
+        p = token_writer__u64(p, t->int_value);
+        *p++ = '|';
+        p = token_writer__float_fixed(p, t->float_value);
+        *p++ = '>';
+        *p++ = '\n';
+        w->used += p - start;
+        return;
+    }
+    if (!token_writer__has_text(t->type)) {
+        *p++ = '\n';
+        w->used += p - start;
+        return;
+    }
+
+    const char *quote = t->type == TOKEN_STRING ? "\"" : "'";
+    *p++ = ' ';
+    p = token_writer__str(p, quote);
+    w->used += p - start;
+    // Stops at a zero byte like the `%s` this replaced
+    const uint8_t *nul = memchr(text.data, 0, text.len);
+    token_writer__bytes(w, text.data, nul ? (uint64_t)(nul - text.data) : text.len);
+    p = start = token_writer__reserve(w, 4);
+    p = token_writer__str(p, quote);
+    *p++ = '\n';
+    w->used += p - start;
+}
+
+void token_writer_init(Token_Writer *w, FILE *f, Token_Format format, Allocator *a)
+{
+    *w = (Token_Writer) {
+        .f = f,
+        .format = format,
+        .allocator = a,
+        .buf = c_alloc(a, TOKEN_WRITER_BUFFER),
+        .capacity = TOKEN_WRITER_BUFFER,
+    };
+    if (format == TOKEN_FORMAT_BINARY) {
+        os_set_binary_mode(f);
+        Token_Binary_Header header = { .magic = TOKEN_BINARY_MAGIC, .version = TOKEN_BINARY_VERSION };
+        token_writer__bytes(w, &header, sizeof(header));
+    }
+}
+
+void token_writer_write(Token_Writer *w, const Token *tokens, uint64_t count, const Atom_Table *atoms,
+    const Source_File *source)
+{
+    int pad = -1;
+    if (w->format == TOKEN_FORMAT_HUMAN) {
+        // Wide enough for the widest line and column, the dashes line up the token names
+        int max_line = 0;
+        int max_char = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            const Token *it = &tokens[i];
+            if (it->l0 > max_line) max_line = it->l0 + 1;
+            if (it->l1 > max_line) max_line = it->l1 + 1;
+            if (it->c0 > max_char) max_char = it->c0;
+            if (it->c1 > max_char) max_char = it->c1;
+        }
+        pad = 6 + (int)token_writer__digits(max_line) * 2 + (int)token_writer__digits(max_char) * 2;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+        const Token *it = &tokens[i];
+        String8 text = { 0 };
+        if (token_writer__has_text(it->type))
+            text = source ? source_file_text(source, it) : atom_get(atoms, it->name)->str;
+        token_writer__token(w, it, text, pad);
+    }
+}
+
+// A token with a byte offset and length instead of a position
+static void token_writer__offset_token(Token_Writer *w, Token_Type type, uint32_t offset, uint32_t length,
+    uint64_t payload, const Line_Index *lines, const Atom_Table *atoms)
+{
+    Token token = { .type = type, .int_value = payload };
+    line_index_lookup(lines, offset, &token.l0, &token.c0);
+    line_index_lookup(lines, offset + length, &token.l1, &token.c1);
+    // Positions of strings start after the opening quote, as they do in tokens from `emit_token`
+    if (type == TOKEN_STRING)
+        token.c0++;
+
+    String8 text = { 0 };
+    if (token_writer__has_text(type))
+        text = atom_get(atoms, token.name)->str;
+    token_writer__token(w, &token, text, -1);
+}
+
+void token_writer_write_compact(Token_Writer *w, const Token_Stream *stream, const Line_Index *lines,
+    const Atom_Table *atoms)
+{
+    for (Token_Iterator it = token_iterator(stream); token_iterator_valid(&it); token_iterator_next(&it)) {
+        token_writer__offset_token(w, token_iterator_type(&it), token_iterator_offset(&it),
+            token_iterator_length(&it), token_iterator_payload(&it).int_value, lines, atoms);
+    }
+}
+
+void token_writer_write_packed(Token_Writer *w, const Token_Pack *pack, const Line_Index *lines,
+    const Atom_Table *atoms)
+{
+    for (Token_Pack_Iterator it = token_pack_iterator(pack, 0); token_pack_iterator_valid(&it); 
+        token_pack_iterator_next(&it)) {
+        token_writer__offset_token(w, it.type, it.offset, it.length, it.payload.int_value, lines, atoms);
+    }
+}
+
+bool token_writer_finish(Token_Writer *w)
+{
+    token_writer__flush(w);
+    c_free(w->allocator, w->buf, w->capacity);
+    w->buf = 0;
+    return !w->failed;
+}
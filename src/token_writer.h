@@ -0,0 +1,74 @@
+#pragma once
+#include "foundation/basic.h"
+#include "lexer.h"
+
+struct Allocator;
+struct Atom_Table;
+struct Source_File;
+struct Token_Stream;
+struct Token_Pack;
+struct Line_Index;
+
+//
+// Buffered token dumps
+//
+// Tokens are formatted by hand into a large buffer that goes out in one `fwrite` whenever it fills
+// up, so dumping a big file costs about as much as writing its bytes. Three formats:
+//
+//   TOKEN_FORMAT_HUMAN   The `[l0,c0->l1,c1] ---> Ident 'name'` lines the lexer has always printed
+//   TOKEN_FORMAT_JSONL   One JSON object per line with the type, 1-based positions and the text or
+//                        value. Numbers have both "int" and "float", the lexer doesn't record which
+//                        one a literal is; "float" is 0 when the bits are a subnormal, as integer
+//                        literals are, and null when they aren't a finite number.
+//   TOKEN_FORMAT_BINARY  A Token_Binary_Header followed by one record per token (see below)
+//
+
+typedef enum Token_Format {
+    TOKEN_FORMAT_HUMAN,
+    TOKEN_FORMAT_JSONL,
+    TOKEN_FORMAT_BINARY,
+} Token_Format;
+
+#define TOKEN_BINARY_MAGIC 0x4b54584cu // "LXTK"
+#define TOKEN_BINARY_VERSION 2
+
+// Every record is the uint32_t type, the int32_t l0, c0, l1 and c1 of Token and 8 payload bytes, all
+// little endian and unpadded. Identifiers and strings have the byte length of their text as payload
+// and are followed by the text. Types are the Token_Type values, which only change when tokens are
+// removed from or reordered in tokens.spec.
+typedef struct Token_Binary_Header {
+    uint32_t magic;
+    uint32_t version;
+} Token_Binary_Header;
+
+#define TOKEN_BINARY_RECORD_SIZE 28
+
+typedef struct Token_Writer {
+    FILE *f;
+    Token_Format format;
+    struct Allocator *allocator;
+    char *buf;
+    uint64_t used;
+    uint64_t capacity;
+    // Set once a write fails, everything after it is dropped
+    bool failed;
+} Token_Writer;
+
+// Start writing tokens to `f` in `format`, binary output starts with its header
+void token_writer_init(Token_Writer *w, FILE *f, Token_Format format, struct Allocator *a);
+
+// Write `count` tokens. Names of identifiers and strings are read from `source` if the tokens were lexed
+// with `lexer_read_source`, and looked up in `atoms` otherwise.
+void token_writer_write(Token_Writer *w, const Token *tokens, uint64_t count, const struct Atom_Table *atoms,
+    const struct Source_File *source);
+
+// Write a compact token stream, positions are resolved through `lines`
+void token_writer_write_compact(Token_Writer *w, const struct Token_Stream *stream, const struct Line_Index *lines,
+    const struct Atom_Table *atoms);
+
+// Write a packed token stream, positions are resolved through `lines`
+void token_writer_write_packed(Token_Writer *w, const struct Token_Pack *pack, const struct Line_Index *lines,
+    const struct Atom_Table *atoms);
+
+// Flush what's left and free the buffer, returns false if any write failed
+bool token_writer_finish(Token_Writer *w);
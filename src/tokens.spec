@@ -0,0 +1,76 @@
+#
+# Token specification
+# tools/dfa_gen.c turns this into lexer_tokens.h, the operator and keyword lists the Token_Type enum
+# is built from, and lexer_dfa.h, the minimized DFA `lexer_step` runs. The premake build regenerates
+# both; adding a token is a line here, it doesn't add a branch to the lexer.
+#
+#   operator NAME "text"   Emits TOKEN_NAME
+#   keyword  NAME "text"   Emits TOKEN_KEYWORD_NAME
+#   chars    "..."         Every byte is a token of its own, its type is the byte
+#   pattern  NAME regex    Hands the match to LEXER_ACTION_NAME in lexer.c, which reads the rest
+#
+# The longest match wins, and between matches of the same length the rule listed first. A regex is a
+# sequence of bytes, \-escapes (\n \r \t \0 \xHH or the byte itself), [sets] with ranges and ^, and .
+# for any byte, each optionally followed by *, + or ?. It runs to the end of the line.
+# Lines starting with # are comments.
+#
+# Operators are numbered from 259 and keywords from 512 in the order they're listed, each in their
+# own range (see Token_Type in lexer.h). Append new ones to keep the existing token types stable.
+#
+
+operator PLUS_EQUALS        "+="
+operator MINUS_EQUALS       "-="
+operator MUL_EQUALS         "*="
+operator DIV_EQUALS         "/="
+operator MOD_EQUALS         "%="
+operator IS_EQUAL           "=="
+operator IS_NOT_EQUAL       "!="
+operator LOGICAL_AND        "&&"
+operator LOGICAL_OR         "||"
+operator LESS_EQUALS        "<="
+operator GREATER_EQUALS     ">="
+operator RIGHT_ARROW        "->"
+operator SHIFT_LEFT         "<<"
+operator SHIFT_RIGHT        ">>"
+operator BITWISE_AND_EQUALS "&="
+operator BITWISE_OR_EQUALS  "|="
+operator BITWISE_XOR_EQUALS "^="
+operator SHIFT_LEFT_EQUALS  "<<="
+operator SHIFT_RIGHT_EQUALS ">>="
+operator ELLIPSIS           "..."
+operator DOUBLE_COLON       "::"
+
+# Listed before IDENTIFIER so they win over it
+keyword IF       "if"
+keyword ELSE     "else"
+keyword THEN     "then"
+keyword CASE     "case"
+keyword RETURN   "return"
+keyword STRUCT   "struct"
+keyword ENUM     "enum"
+keyword WHILE    "while"
+keyword BREAK    "break"
+keyword CONTINUE "continue"
+keyword SWITCH   "switch"
+keyword DEFER    "defer"
+keyword SIZE_OF  "sizeof"
+keyword TYPE_OF  "typeof"
+keyword TRUE     "true"
+keyword FALSE    "false"
+keyword NULL     "null"
+
+chars "!#$%&()*+,-./:;<=>?@[\\]^`{|}~"
+
+# Whitespace and control characters, the action skips the whole run
+pattern SKIP           [\x00-\x20\x7f]
+# Non-ASCII bytes are taken as identifier bytes, the action checks them against the Unicode XID classes
+# and ends the identifier early or skips the code point if they don't belong to one
+pattern IDENTIFIER     [A-Za-z_\x80-\xff][A-Za-z0-9_\x80-\xff]*
+pattern NUMBER_DECIMAL [0-9]+
+pattern NUMBER_FLOAT   [0-9]+\.[0-9.]*
+pattern NUMBER_HEX     0x[0-9A-Fa-f]*
+pattern NUMBER_BINARY  0b[01]*
+# Strings and comments match their opening, the action reads the body
+pattern STRING         ["']
+pattern LINE_COMMENT   //
+pattern BLOCK_COMMENT  /\*
@@ -0,0 +1,67 @@
+#include "utf8.h"
+#include "char_class.h"
+#include "unicode_xid.h"
+
+#define UTF8_NUM_XID_START (uint32_t)(sizeof(unicode_xid_start) / sizeof(unicode_xid_start[0]))
+#define UTF8_NUM_XID_CONTINUE (uint32_t)(sizeof(unicode_xid_continue) / sizeof(unicode_xid_continue[0]))
+
+static bool utf8__in_ranges(const Unicode_Range *ranges, uint32_t count, uint32_t cp)
+{
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (cp > ranges[mid].hi)
+            lo = mid + 1;
+        else if (cp < ranges[mid].lo)
+            hi = mid;
+        else
+            return true;
+    }
+    return false;
+}
+
+bool utf8_is_xid_start(uint32_t cp)
+{
+    if (cp < 0x80)
+        return (char_class[cp] & CHAR_IDENT_START) != 0;
+    return utf8__in_ranges(unicode_xid_start, UTF8_NUM_XID_START, cp);
+}
+
+bool utf8_is_xid_continue(uint32_t cp)
+{
+    if (cp < 0x80)
+        return (char_class[cp] & CHAR_IDENT) != 0;
+    return utf8__in_ranges(unicode_xid_continue, UTF8_NUM_XID_CONTINUE, cp);
+}
+
+uint64_t utf8_scan_identifier(const uint8_t *data, uint64_t pos, uint64_t end, uint64_t size)
+{
+    uint64_t start = pos;
+    while (pos < end) {
+        // ASCII blocks are skipped with a single test each
+        pos = scan_non_ascii(data, pos, end, size);
+        if (pos == end)
+            break;
+        uint32_t cp;
+        uint32_t len = utf8_decode(data + pos, end - pos, &cp);
+        if (len == 0 || !(pos == start ? utf8_is_xid_start(cp) : utf8_is_xid_continue(cp)))
+            break;
+        pos += len;
+    }
+    return pos;
+}
+
+bool utf8_validate(const uint8_t *data, uint64_t pos, uint64_t end, uint64_t size)
+{
+    while (pos < end) {
+        pos = scan_non_ascii(data, pos, end, size);
+        if (pos == end)
+            break;
+        uint32_t cp;
+        uint32_t len = utf8_decode(data + pos, end - pos, &cp);
+        if (len == 0)
+            return false;
+        pos += len;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "foundation/basic.h"
+
+//
+// UTF-8 decoding and validation
+// Sources are lexed as bytes and ASCII is handled by the byte tables and scan kernels, these are only
+// reached for runs that `scan_non_ascii` found to contain a byte >= 0x80.
+//
+
+#define UTF8_MAX_LENGTH 4
+
+// Decode the sequence at `p`, which has `avail` bytes. Returns its length, or 0 if it's overlong,
+// a surrogate, above U+10FFFF or cut off.
+static inline uint32_t utf8_decode(const uint8_t *p, uint64_t avail, uint32_t *cp)
+{
+    uint8_t b0 = p[0];
+    if (b0 < 0x80) {
+        *cp = b0;
+        return 1;
+    }
+
+    uint32_t len, min;
+    if (b0 >= 0xc2 && b0 <= 0xdf) {
+        len = 2;
+        min = 0x80;
+        *cp = b0 & 0x1f;
+    } else if (b0 >= 0xe0 && b0 <= 0xef) {
+        len = 3;
+        min = 0x800;
+        *cp = b0 & 0x0f;
+    } else if (b0 >= 0xf0 && b0 <= 0xf4) {
+        len = 4;
+        min = 0x10000;
+        *cp = b0 & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (avail < len)
+        return 0;
+    for (uint32_t i = 1; i < len; ++i) {
+        if ((p[i] & 0xc0) != 0x80)
+            return 0;
+        *cp = (*cp << 6) | (p[i] & 0x3f);
+    }
+    if (*cp < min || *cp > 0x10ffff || (*cp >= 0xd800 && *cp <= 0xdfff))
+        return 0;
+    return len;
+}
+
+bool utf8_is_xid_start(uint32_t cp);
+bool utf8_is_xid_continue(uint32_t cp);
+
+// Returns the end of the identifier at the start of [pos, end), a run of bytes the DFA matched as
+// identifier bytes. ASCII bytes in it are already known to be identifier characters, other code points
+// must be XID_Start at the start and XID_Continue after it. Returns `pos` if the first code point
+// can't start an identifier.
+uint64_t utf8_scan_identifier(const uint8_t *data, uint64_t pos, uint64_t end, uint64_t size);
+
+// Returns true if [pos, end) is valid UTF-8
+bool utf8_validate(const uint8_t *data, uint64_t pos, uint64_t end, uint64_t size);
@@ -0,0 +1,240 @@
+//
+// Number parsing test
+// Compares `parse_f64` with `strtod` and the integer parsers with `strtoull`: random doubles printed
+// at every precision, the edges of the exact path and of the Eisel-Lemire range, subnormals, long
+// mantissas that need the fallback, and overflow. Prints every mismatch and exits with 1 if any.
+//
+
+#include "foundation/basic.h"
+#include "foundation/parse_number.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARSE_TEST_RANDOM 200000
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+static uint32_t num_failed;
+
+static uint64_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static uint64_t f64_bits(double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+static void check_f64(const char *str)
+{
+    uint64_t len = strlen(str);
+    double expected = strtod(str, NULL);
+    double value = -1.0;
+    uint64_t used = parse_f64((const uint8_t *)str, len, &value);
+    if (used != len || f64_bits(value) != f64_bits(expected)) {
+        if (num_failed++ < 20)
+            printf("parse_f64(\"%.80s\") = %.17g (%llu bytes), strtod gives %.17g\n", str, value,
+                (unsigned long long)used, expected);
+    }
+}
+
+typedef bool Parse_U64(const uint8_t *str, uint64_t len, uint64_t *value);
+
+static void check_u64(Parse_U64 *parse, const char *str, int base)
+{
+    errno = 0;
+    uint64_t expected = strtoull(str, NULL, base);
+    bool expected_ok = errno != ERANGE;
+    uint64_t value = 0;
+    bool ok = parse((const uint8_t *)str, strlen(str), &value);
+    if (ok != expected_ok || value != expected) {
+        if (num_failed++ < 20)
+            printf("parse_u64 base %d (\"%.80s\") = %llu (%s), strtoull gives %llu (%s)\n", base, str,
+                (unsigned long long)value, ok ? "ok" : "overflow", (unsigned long long)expected,
+                expected_ok ? "ok" : "overflow");
+    }
+}
+
+// `w`, then `fraction` and the exponent, e.g. "9007199254740993.5e-22"
+static void check_f64_parts(uint64_t w, const char *fraction, int64_t exponent)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%llu%se%lld", (unsigned long long)w, fraction, (long long)exponent);
+    check_f64(buf);
+}
+
+static void test_random_doubles(void)
+{
+    char buf[64];
+    for (uint32_t i = 0; i < PARSE_TEST_RANDOM; ++i) {
+        // Any finite positive double, the lexer never sees a sign
+        uint64_t bits = random_next() & ~(1ULL << 63);
+        if ((bits >> 52) == 0x7FF)
+            continue;
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        snprintf(buf, sizeof(buf), "%.17g", d);
+        check_f64(buf);
+        snprintf(buf, sizeof(buf), "%.*e", (int)(random_next() % 25), d);
+        check_f64(buf);
+    }
+
+    // Random decimal strings, mostly within the 19 digits of the fast paths
+    for (uint32_t i = 0; i < PARSE_TEST_RANDOM; ++i) {
+        uint32_t num_digits = 1 + (uint32_t)(random_next() % 24);
+        uint32_t point = (uint32_t)(random_next() % (num_digits + 1));
+        uint64_t n = 0;
+        for (uint32_t j = 0; j < num_digits; ++j) {
+            if (j == point && j > 0)
+                buf[n++] = '.';
+            buf[n++] = (char)('0' + random_next() % 10);
+        }
+        n += snprintf(buf + n, sizeof(buf) - n, "e%d", (int)(random_next() % 700) - 350);
+        check_f64(buf);
+    }
+}
+
+static void test_edges(void)
+{
+    static const char *cases[] = {
+        "0", "0.0", "0e0", "000.000e10", "1", "1.", ".5", "0.1", "0.3", "1e0", "1e+5", "1E-5",
+        // Exact path, w up to 2^53 and powers of ten up to 10^22
+        "9007199254740992", "9007199254740993", "9007199254740991e22", "9007199254740992e22",
+        "9007199254740993e22", "9007199254740992e-22", "9007199254740993e-22", "1e22", "1e23", "1e-22",
+        "1e-23", "123456789e22", "123456789e-22", "4503599627370497.5",
+        // Eisel-Lemire range and its 19 digits
+        "9999999999999999999", "99999999999999999999", "18446744073709551615", "18446744073709551616",
+        "1e-342", "1e-343", "1e308", "1e309", "9999999999999999999e-361", "1234567890123456789e-342",
+        "1234567890123456789e289", "7.2057594037927933e16", "9.007199254740993e15",
+        // Halfway cases
+        "2.2250738585072012e-308", "2.2250738585072011e-308", "2.2250738585072014e-308",
+        "9007199254740993.0000000000001", "9007199254740994.9999999999999", "1.00000000000000011102230246251565",
+        // Subnormals
+        "4.9406564584124654e-324", "4.9e-324", "5e-324", "2.4703282292062327e-324",
+        "2.4703282292062328e-324", "2.47032822920623272e-324", "1e-320", "2.2250738585072009e-308",
+        "1.5e-323", "3e-324",
+        // Overflow and the largest doubles
+        "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "1e400", "1e99999",
+        "179769313486231580793728971405301e276", "179769313486231580793728971405302e276",
+        "0e99999", "0.0000001e-99999",
+    };
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i)
+        check_f64(cases[i]);
+
+    // Around the exact path limits for every power
+    static const uint64_t mantissas[] = { 1, 9007199254740991, 9007199254740992, 9007199254740993,
+        9007199254740995, 10000000000000000000ULL, 9999999999999999999ULL };
+    for (uint32_t i = 0; i < sizeof(mantissas) / sizeof(*mantissas); ++i) {
+        for (int64_t e = -30; e <= 30; ++e)
+            check_f64_parts(mantissas[i], "", e);
+        for (int64_t e = -350; e <= -320; ++e)
+            check_f64_parts(mantissas[i], "", e);
+        for (int64_t e = 280; e <= 310; ++e)
+            check_f64_parts(mantissas[i], "", e);
+    }
+}
+
+// Mantissas longer than 19 digits, the dropped digits only sometimes matter
+static void test_long_mantissas(void)
+{
+    // Smallest subnormal halfway point written out in full, then just above and below it
+    static const char halfway[] =
+        "2.4703282292062327208828439643411068618252990130716238221279284125033775363510437593264991818081799618"
+        "9898282347722858865463328355177969898199387398005390939063150356595155702263922908583924491051844359"
+        "3180284993653615250031937045767824921936562366986365848075700158576926990370631192827955855133292783"
+        "4338409351978015531246597263579574622766465272827220056374006485499977096599470454020828166226237857"
+        "3934507363390079677619305775067401763246736009689513405355374585166611342237666786041621596804619144"
+        "6729184030053005753084904876539171138659164623952491262365388187963623937328042389101867234849766823"
+        "5089863388587925628302755995657524455507255189313690836254779186948667994968324049705821028513185451"
+        "3962138377228261454376934125320985913276672363281";
+    char buf[sizeof(halfway) + 16];
+    snprintf(buf, sizeof(buf), "%s25e-324", halfway);
+    check_f64(buf);
+    snprintf(buf, sizeof(buf), "%s24e-324", halfway);
+    check_f64(buf);
+    snprintf(buf, sizeof(buf), "%s26e-324", halfway);
+    check_f64(buf);
+
+    check_f64_parts(9007199254740993, ".0000000000000000000000000000001", 0);
+    check_f64_parts(9007199254740992, ".9999999999999999999999999999999", 0);
+    check_f64_parts(1, "00000000000000000000000000000000000000000001", 0);
+
+    // 2^53 + 1 is halfway between two doubles, any trailing digit decides it
+    char digits[96];
+    for (uint32_t i = 0; i < PARSE_TEST_RANDOM / 10; ++i) {
+        uint64_t n = (uint64_t)snprintf(digits, sizeof(digits), "%llu",
+            (unsigned long long)(9007199254740993ULL + 2 * (random_next() % 1000)));
+        uint32_t extra = 1 + (uint32_t)(random_next() % 40);
+        for (uint32_t j = 0; j < extra; ++j)
+            digits[n++] = random_next() % 4 ? '0' : (char)('0' + random_next() % 10);
+        digits[n] = 0;
+        char full[128];
+        snprintf(full, sizeof(full), "%se%d", digits, -(int)extra + (int)(random_next() % 5) - 2);
+        check_f64(full);
+    }
+
+    for (uint32_t i = 0; i < PARSE_TEST_RANDOM / 10; ++i) {
+        uint32_t num_digits = 20 + (uint32_t)(random_next() % 60);
+        uint64_t n = 0;
+        for (uint32_t j = 0; j < num_digits; ++j)
+            digits[n++] = (char)('0' + (j == 0 ? 1 + random_next() % 9 : random_next() % 10));
+        snprintf(digits + n, sizeof(digits) - n, "e%d", (int)(random_next() % 700) - 380);
+        check_f64(digits);
+    }
+}
+
+static void test_integers(void)
+{
+    static const char *decimal[] = {
+        "", "0", "00000000000000000000000001", "9", "4294967295", "4294967296", "9999999999999999999",
+        "18446744073709551615", "18446744073709551616", "18446744073709551625", "99999999999999999999",
+        "000000000000000000000018446744073709551615", "184467440737095516150",
+    };
+    for (uint32_t i = 0; i < sizeof(decimal) / sizeof(*decimal); ++i)
+        check_u64(parse_u64_decimal, decimal[i], 10);
+
+    static const char *hex[] = {
+        "", "0", "f", "F", "deadBEEF", "ffffffffffffffff", "10000000000000000", "0000000000000000000ffffffffffffffff",
+    };
+    for (uint32_t i = 0; i < sizeof(hex) / sizeof(*hex); ++i)
+        check_u64(parse_u64_hex, hex[i], 16);
+
+    char buf[80];
+    for (uint32_t i = 0; i < PARSE_TEST_RANDOM; ++i) {
+        uint64_t v = random_next() >> (random_next() % 64);
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+        check_u64(parse_u64_decimal, buf, 10);
+        snprintf(buf, sizeof(buf), "%llx", (unsigned long long)v);
+        check_u64(parse_u64_hex, buf, 16);
+
+        uint64_t n = 0;
+        uint32_t num_bits = 1 + (uint32_t)(random_next() % 66);
+        for (uint32_t j = 0; j < num_bits; ++j)
+            buf[n++] = (char)('0' + (random_next() & 1));
+        buf[n] = 0;
+        check_u64(parse_u64_binary, buf, 2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_edges();
+    test_random_doubles();
+    test_long_mantissas();
+    test_integers();
+
+    if (num_failed) {
+        printf("Number parsing test: %u mismatches\n", num_failed);
+        return 1;
+    }
+    printf("Number parsing test: ok\n");
+    return 0;
+}
@@ -0,0 +1,181 @@
+//
+// Relex test
+// Applies random edits to a text built from fragments that open and close comments, strings and
+// multi character operators, relexes after every edit and compares the stream and line index
+// with a full lex of the edited text. Exits with 1 on the first mismatch.
+//
+
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/array.h"
+#include "foundation/atom.h"
+#include "lexer.h"
+#include "line_index.h"
+#include "token_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RELEX_TEST_EDITS 5000
+#define RELEX_TEST_MAX_SIZE 60000
+
+static const char *fragments[] = {
+    "a", "bc", " ", "\n", "\t", "/*", "*/", "//", "\"", "'", "\\", "0x", "1", "12.5", ".", "..", "+", "-",
+    "=", ">", "<", ":", "<<", ">>=", "if", "while", "x_1",
+    // Pieces of U+203F, which continues an identifier, and U+00E9
+    "\xE2\x80", "\xBF", "\xC3\xA9",
+    // Longer than TOKEN_STREAM_LONG_LENGTH
+    "long_identifier_xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
+};
+
+static uint32_t random_state = 1;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static uint64_t append_fragments(char *dst, uint32_t count)
+{
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const char *f = fragments[random_next() % (sizeof(fragments) / sizeof(*fragments))];
+        uint64_t len = strlen(f);
+        memcpy(dst + n, f, len);
+        n += len;
+    }
+    return n;
+}
+
+static bool streams_equal(const Token_Stream *a, const Token_Stream *b)
+{
+    if (token_stream_size(a) != token_stream_size(b))
+        return false;
+    if (array_size(a->names) != array_size(b->names) || array_size(a->numbers) != array_size(b->numbers)
+        || array_size(a->long_lengths) != array_size(b->long_lengths))
+        return false;
+
+    Token_Iterator it = token_iterator(a);
+    for (uint64_t i = 0; i < token_stream_size(a); ++i, token_iterator_next(&it)) {
+        if (token_stream_type(a, i) != token_stream_type(b, i)
+            || token_stream_offset(a, i) != token_stream_offset(b, i)
+            || token_stream_length(a, i) != token_stream_length(b, i)
+            || token_stream_payload(a, i).int_value != token_stream_payload(b, i).int_value)
+            return false;
+        if (token_iterator_length(&it) != token_stream_length(a, i)
+            || token_iterator_payload(&it).int_value != token_stream_payload(a, i).int_value)
+            return false;
+    }
+
+    for (uint64_t i = 0; i < array_size(a->name_rank.bits); ++i) {
+        if (a->name_rank.bits[i] != b->name_rank.bits[i] || a->name_rank.base[i] != b->name_rank.base[i]
+            || a->number_rank.bits[i] != b->number_rank.bits[i]
+            || a->number_rank.base[i] != b->number_rank.base[i])
+            return false;
+    }
+    return true;
+}
+
+static bool lines_equal(const Line_Index *a, const Line_Index *b)
+{
+    return array_size(a->line_starts) == array_size(b->line_starts)
+        && memcmp(a->line_starts, b->line_starts, array_size(a->line_starts) * sizeof(*a->line_starts)) == 0;
+}
+
+// Relex `before` after replacing bytes [start, start + removed) with `inserted` and compare with a full lex
+static bool relex_case(const char *before, uint64_t start, uint64_t removed, const char *inserted,
+    Atom_Table *atoms, Allocator *allocator)
+{
+    char text[256];
+    uint64_t size = strlen(before);
+    uint64_t n = strlen(inserted);
+    memcpy(text, before, start);
+    memcpy(text + start, inserted, n);
+    memcpy(text + start + n, before + start + removed, size - start - removed);
+    uint64_t new_size = size - removed + n;
+
+    Token_Stream stream = { 0 };
+    Token_Stream full = { 0 };
+    lexer_relex(&stream, (const uint8_t *)before, size, (Lexer_Edit) { .inserted = size }, atoms, allocator);
+    Lexer_Edit e = { .start = start, .removed = removed, .inserted = n };
+    lexer_relex(&stream, (const uint8_t *)text, new_size, e, atoms, allocator);
+    lexer_relex(&full, (const uint8_t *)text, new_size, (Lexer_Edit) { .inserted = new_size }, atoms, allocator);
+    bool ok = streams_equal(&stream, &full);
+    token_stream_free(&stream, allocator);
+    token_stream_free(&full, allocator);
+
+    if (!ok)
+        printf("Relex test: tokens differ from a full lex after editing \"%s\" at %llu\n", before,
+            (unsigned long long)start);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    Allocator *allocator = system_allocator;
+    Atom_Table *atoms = atom_table_create(MB(1));
+
+    // Completing U+203F, which is XID_Continue, makes the identifier before it grow by 3 bytes
+    int res = relex_case("a\xE2\x80" "A b", 3, 1, "\xBF", atoms, allocator) ? 0 : 1;
+
+    char *text = malloc(RELEX_TEST_MAX_SIZE + KB(4));
+    uint64_t size = append_fragments(text, 2000);
+
+    Token_Stream stream = { 0 };
+    Line_Index lines = { 0 };
+    lexer_relex(&stream, (const uint8_t *)text, size, (Lexer_Edit) { .inserted = size }, atoms, allocator);
+    line_index_build(&lines, (const uint8_t *)text, size, allocator);
+
+    for (uint32_t edit = 0; res == 0 && edit < RELEX_TEST_EDITS; ++edit) {
+        char inserted[KB(4)];
+        uint64_t start = random_next() % (size + 1);
+        uint64_t removed = random_next() % 8;
+        uint64_t n = append_fragments(inserted, random_next() % 6);
+        if (start + removed > size)
+            removed = size - start;
+        if (size - removed + n > RELEX_TEST_MAX_SIZE) {
+            n = 0;
+            removed = size - start < 40 ? size - start : 40;
+        }
+
+        memmove(text + start + n, text + start + removed, size - start - removed);
+        memcpy(text + start, inserted, n);
+        size = size - removed + n;
+
+        Lexer_Edit e = { .start = start, .removed = removed, .inserted = n };
+        lexer_relex(&stream, (const uint8_t *)text, size, e, atoms, allocator);
+        line_index_update(&lines, (const uint8_t *)text, start, removed, n, allocator);
+
+        Token_Stream full = { 0 };
+        Line_Index full_lines = { 0 };
+        lexer_relex(&full, (const uint8_t *)text, size, (Lexer_Edit) { .inserted = size }, atoms, allocator);
+        line_index_build(&full_lines, (const uint8_t *)text, size, allocator);
+        bool tokens_ok = streams_equal(&stream, &full);
+        bool lines_ok = lines_equal(&lines, &full_lines);
+        token_stream_free(&full, allocator);
+        line_index_free(&full_lines, allocator);
+
+        if (!tokens_ok || !lines_ok) {
+            printf("Relex test: %s differ from a full lex after edit %u (start %llu, removed %llu, inserted %llu)\n",
+                tokens_ok ? "lines" : "tokens", edit, (unsigned long long)start, (unsigned long long)removed,
+                (unsigned long long)n);
+            res = 1;
+            break;
+        }
+    }
+
+    if (res == 0)
+        printf("Relex test: %u edits ok\n", RELEX_TEST_EDITS);
+
+    token_stream_free(&stream, allocator);
+    line_index_free(&lines, allocator);
+    atom_table_destroy(atoms);
+    free(text);
+    return res;
+}
@@ -0,0 +1,775 @@
+//
+// Lexer DFA generator
+// Usage: dfa_gen <tokens.spec> <lexer_tokens.h> <lexer_dfa.h>
+//
+// Reads the token specification (the format is described at the top of src/tokens.spec) and
+// writes the operator and keyword lists the Token_Type enum is built from, and the DFA the lexer
+// runs. Every rule becomes a chain of NFA states, one per item, which are turned into a DFA by
+// subset construction and minimized by partition refinement. Bytes that every state treats the
+// same are merged into one equivalence class, so the transition table has a column per class
+// instead of per byte. Outputs are only written when their contents change, regenerating doesn't
+// cause rebuilds.
+//
+
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/array.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+// Operators are token types from 259 and keywords from 512, limited to as many as have a byte code
+// (see Token_Type and token_type_code in src/lexer.h). Chars have to be ASCII for the same reason.
+#define DFA_GEN_MAX_OPERATORS 61
+#define DFA_GEN_MAX_KEYWORDS 62
+
+typedef enum Rule_Kind {
+    RULE_OPERATOR,
+    RULE_KEYWORD,
+    RULE_CHAR,
+    RULE_PATTERN,
+} Rule_Kind;
+
+// A set of bytes matched once, or repeated as given by `repeat`
+typedef struct Rule_Item {
+    uint64_t set[4];
+    // 0, '*', '+' or '?'
+    char repeat;
+} Rule_Item;
+
+typedef struct Rule {
+    Rule_Kind kind;
+    // Token or action name, empty for chars
+    char name[64];
+    // Text of operators and keywords, the byte of chars
+    char text[64];
+    Rule_Item *items;
+    // NFA state `nfa_first + k` is reached once the first k items are matched
+    uint32_t nfa_first;
+    // Index into `outputs`, rules with the same output can share DFA states
+    uint32_t output;
+    uint32_t line;
+} Rule;
+
+typedef struct Gen {
+    Rule *rules;
+    // What a rule emits, a token expression for fixed tokens or an action name for patterns
+    char (*outputs)[80];
+    // Pattern names in the order they first appear
+    char (*actions)[64];
+    uint32_t num_nfa;
+    uint32_t nfa_words;
+
+    // Subset DFA, state 0 is the empty set
+    uint64_t *sets;
+    uint32_t *next;
+    int32_t *accept;
+    uint32_t num_states;
+
+    // Minimized DFA, state 0 is dead and state 1 the start
+    uint32_t *min_next;
+    int32_t *min_accept;
+    uint32_t num_min;
+
+    uint8_t byte_class[256];
+    uint32_t num_classes;
+    uint32_t class_bits;
+    uint32_t lookahead;
+} Gen;
+
+static void fail(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    printf("dfa_gen: ");
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+    exit(1);
+}
+
+//
+// Spec parsing
+//
+
+static inline void set_add(uint64_t *set, uint32_t c)
+{
+    set[c / 64] |= 1ULL << (c % 64);
+}
+
+static inline bool set_has(const uint64_t *set, uint32_t c)
+{
+    return (set[c / 64] >> (c % 64)) & 1;
+}
+
+static uint32_t hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 16;
+}
+
+// Reads one byte at `*p`, which may be a \-escape
+static uint8_t parse_byte(const char **p, uint32_t line)
+{
+    const char *s = *p;
+    if (*s != '\\') {
+        *p = s + 1;
+        return (uint8_t)*s;
+    }
+    ++s;
+    uint8_t c = (uint8_t)*s++;
+    switch (c) {
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case '0': c = 0; break;
+        case 'x': {
+            uint32_t hi = hex_value(s[0]);
+            uint32_t lo = hi < 16 ? hex_value(s[1]) : 16;
+            if (lo >= 16)
+                fail("line %u: expected two hex digits after \\x", line);
+            c = (uint8_t)(hi * 16 + lo);
+            s += 2;
+            break;
+        }
+        case 0: fail("line %u: \\ at the end of the line", line);
+    }
+    *p = s;
+    return c;
+}
+
+static const char *skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        ++p;
+    return p;
+}
+
+static const char *parse_name(const char *p, char *name, uint32_t line)
+{
+    uint32_t len = 0;
+    while ((*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_') {
+        if (len + 1 >= 64)
+            fail("line %u: name too long", line);
+        name[len++] = *p++;
+    }
+    if (len == 0)
+        fail("line %u: expected an upper case name", line);
+    name[len] = 0;
+    return p;
+}
+
+// Returns the number of bytes of the quoted string at `p` written to `text`
+static uint32_t parse_quoted(const char **p, char *text, uint32_t cap, uint32_t line)
+{
+    const char *s = *p;
+    if (*s != '"')
+        fail("line %u: expected a quoted string", line);
+    ++s;
+    uint32_t len = 0;
+    while (*s != '"') {
+        if (*s == 0)
+            fail("line %u: unterminated string", line);
+        if (len + 1 >= cap)
+            fail("line %u: string too long", line);
+        text[len++] = (char)parse_byte(&s, line);
+    }
+    text[len] = 0;
+    *p = s + 1;
+    return len;
+}
+
+static Rule_Item *items_from_text(const char *text, uint32_t len)
+{
+    Rule_Item *items = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+        Rule_Item item = { 0 };
+        set_add(item.set, (uint8_t)text[i]);
+        array_push(items, item, system_allocator);
+    }
+    return items;
+}
+
+static Rule_Item *items_from_regex(const char *p, uint32_t line)
+{
+    Rule_Item *items = 0;
+    bool can_be_empty = true;
+    while (*p) {
+        Rule_Item item = { 0 };
+        if (*p == '[') {
+            ++p;
+            bool negate = *p == '^';
+            if (negate)
+                ++p;
+            bool first = true;
+            while (*p != ']' || first) {
+                if (*p == 0)
+                    fail("line %u: unterminated [", line);
+                uint32_t lo = parse_byte(&p, line);
+                uint32_t hi = lo;
+                if (p[0] == '-' && p[1] != ']' && p[1] != 0) {
+                    ++p;
+                    hi = parse_byte(&p, line);
+                }
+                if (hi < lo)
+                    fail("line %u: bad range", line);
+                for (uint32_t c = lo; c <= hi; ++c)
+                    set_add(item.set, c);
+                first = false;
+            }
+            ++p;
+            if (negate) {
+                for (uint32_t i = 0; i < 4; ++i)
+                    item.set[i] = ~item.set[i];
+            }
+        } else if (*p == '.') {
+            ++p;
+            memset(item.set, 0xff, sizeof(item.set));
+        } else {
+            set_add(item.set, parse_byte(&p, line));
+        }
+        if (*p == '*' || *p == '+' || *p == '?')
+            item.repeat = *p++;
+        if (!(item.set[0] | item.set[1] | item.set[2] | item.set[3]))
+            fail("line %u: empty set", line);
+        can_be_empty &= item.repeat == '*' || item.repeat == '?';
+        array_push(items, item, system_allocator);
+    }
+    if (can_be_empty)
+        fail("line %u: pattern matches the empty string", line);
+    return items;
+}
+
+static uint32_t add_output(Gen *gen, const char *output)
+{
+    for (uint32_t i = 0; i < array_size(gen->outputs); ++i) {
+        if (strcmp(gen->outputs[i], output) == 0)
+            return i;
+    }
+    array_ensure(gen->outputs, array_size(gen->outputs) + 1, system_allocator);
+    snprintf(gen->outputs[array_size(gen->outputs)], sizeof(*gen->outputs), "%s", output);
+    array_header(gen->outputs)->size++;
+    return (uint32_t)array_size(gen->outputs) - 1;
+}
+
+static void add_rule(Gen *gen, Rule rule)
+{
+    char output[80];
+    if (rule.kind == RULE_OPERATOR) {
+        snprintf(output, sizeof(output), "TOKEN_%s", rule.name);
+    } else if (rule.kind == RULE_KEYWORD) {
+        snprintf(output, sizeof(output), "TOKEN_KEYWORD_%s", rule.name);
+    } else if (rule.kind == RULE_CHAR) {
+        snprintf(output, sizeof(output), "%u", (uint8_t)rule.text[0]);
+    } else {
+        snprintf(output, sizeof(output), "LEXER_ACTION_%s", rule.name);
+        bool seen = false;
+        for (uint32_t i = 0; i < array_size(gen->actions); ++i)
+            seen |= strcmp(gen->actions[i], rule.name) == 0;
+        if (!seen) {
+            array_ensure(gen->actions, array_size(gen->actions) + 1, system_allocator);
+            memcpy(gen->actions[array_size(gen->actions)], rule.name, sizeof(rule.name));
+            array_header(gen->actions)->size++;
+        }
+    }
+    if (rule.kind != RULE_PATTERN) {
+        for (Rule *it = gen->rules; it != array_end(gen->rules); ++it) {
+            if (it->kind == rule.kind && rule.kind != RULE_CHAR && strcmp(it->name, rule.name) == 0)
+                fail("line %u: %s is defined twice", rule.line, rule.name);
+        }
+    }
+    rule.output = add_output(gen, output);
+    array_push(gen->rules, rule, system_allocator);
+}
+
+static void parse_spec(Gen *gen, char *spec)
+{
+    uint32_t line = 0;
+    for (char *p = spec; *p;) {
+        char *end = strchr(p, '\n');
+        char *next = end ? end + 1 : p + strlen(p);
+        if (end) {
+            *end = 0;
+            if (end > p && end[-1] == '\r')
+                end[-1] = 0;
+        }
+        ++line;
+
+        const char *s = skip_space(p);
+        p = next;
+        if (*s == 0 || *s == '#')
+            continue;
+
+        Rule rule = { .line = line };
+        if (strncmp(s, "operator ", 9) == 0 || strncmp(s, "keyword ", 8) == 0) {
+            rule.kind = s[0] == 'o' ? RULE_OPERATOR : RULE_KEYWORD;
+            s = parse_name(skip_space(strchr(s, ' ')), rule.name, line);
+            s = skip_space(s);
+            uint32_t len = parse_quoted(&s, rule.text, sizeof(rule.text), line);
+            if (len == 0)
+                fail("line %u: empty token", line);
+            rule.items = items_from_text(rule.text, len);
+            add_rule(gen, rule);
+        } else if (strncmp(s, "chars ", 6) == 0) {
+            char text[256];
+            s = skip_space(s + 6);
+            uint32_t len = parse_quoted(&s, text, sizeof(text), line);
+            for (uint32_t i = 0; i < len; ++i) {
+                if ((uint8_t)text[i] >= 0x80)
+                    fail("line %u: chars have to be ASCII", line);
+                Rule char_rule = { .kind = RULE_CHAR, .line = line };
+                char_rule.text[0] = text[i];
+                char_rule.items = items_from_text(text + i, 1);
+                add_rule(gen, char_rule);
+            }
+            continue;
+        } else if (strncmp(s, "pattern ", 8) == 0) {
+            rule.kind = RULE_PATTERN;
+            s = parse_name(skip_space(s + 8), rule.name, line);
+            s = skip_space(s);
+            // The regex runs to the end of the line
+            char *regex_end = (char *)s + strlen(s);
+            while (regex_end > s && (regex_end[-1] == ' ' || regex_end[-1] == '\t'))
+                *--regex_end = 0;
+            if (*s == 0)
+                fail("line %u: missing pattern", line);
+            rule.items = items_from_regex(s, line);
+            add_rule(gen, rule);
+        } else {
+            fail("line %u: unknown rule, expected operator, keyword, chars or pattern", line);
+        }
+        s = skip_space(s);
+        if (rule.kind != RULE_PATTERN && *s != 0)
+            fail("line %u: unexpected text after the rule", line);
+    }
+
+    if (array_size(gen->rules) == 0)
+        fail("no rules");
+
+    // Operators and keywords are numbered within fixed ranges of Token_Type
+    uint32_t num_operators = 0, num_keywords = 0;
+    for (const Rule *rule = gen->rules; rule != array_end(gen->rules); ++rule) {
+        num_operators += rule->kind == RULE_OPERATOR;
+        num_keywords += rule->kind == RULE_KEYWORD;
+    }
+    if (num_operators > DFA_GEN_MAX_OPERATORS)
+        fail("%u operators, at most %u have a type code", num_operators, DFA_GEN_MAX_OPERATORS);
+    if (num_keywords > DFA_GEN_MAX_KEYWORDS)
+        fail("%u keywords, at most %u have a type code", num_keywords, DFA_GEN_MAX_KEYWORDS);
+}
+
+//
+// NFA and subset construction
+//
+
+// Add state k of `rule` and every state reachable from it by skipping optional items
+static void add_closure(const Rule *rule, uint32_t k, uint64_t *set)
+{
+    uint32_t n = (uint32_t)array_size(rule->items);
+    set_add(set, rule->nfa_first + k);
+    while (k < n && (rule->items[k].repeat == '*' || rule->items[k].repeat == '?'))
+        set_add(set, rule->nfa_first + ++k);
+}
+
+// Highest priority rule accepting in `set`, rules listed first win, or -1
+static int32_t set_accept(const Gen *gen, const uint64_t *set)
+{
+    for (uint32_t r = 0; r < array_size(gen->rules); ++r) {
+        const Rule *rule = &gen->rules[r];
+        if (set_has(set, rule->nfa_first + (uint32_t)array_size(rule->items)))
+            return (int32_t)r;
+    }
+    return -1;
+}
+
+static uint32_t find_or_add_state(Gen *gen, const uint64_t *set)
+{
+    uint32_t words = gen->nfa_words;
+    for (uint32_t i = 0; i < gen->num_states; ++i) {
+        if (memcmp(gen->sets + (uint64_t)i * words, set, words * sizeof(uint64_t)) == 0)
+            return i;
+    }
+    array_join(gen->sets, set, words, system_allocator);
+    for (uint32_t b = 0; b < 256; ++b)
+        array_push(gen->next, 0, system_allocator);
+    array_push(gen->accept, set_accept(gen, set), system_allocator);
+    return gen->num_states++;
+}
+
+static void build_dfa(Gen *gen)
+{
+    for (Rule *rule = gen->rules; rule != array_end(gen->rules); ++rule) {
+        rule->nfa_first = gen->num_nfa;
+        gen->num_nfa += (uint32_t)array_size(rule->items) + 1;
+    }
+    gen->nfa_words = (gen->num_nfa + 63) / 64;
+
+    uint64_t *set = calloc(gen->nfa_words, sizeof(uint64_t));
+    find_or_add_state(gen, set);
+    for (Rule *rule = gen->rules; rule != array_end(gen->rules); ++rule)
+        add_closure(rule, 0, set);
+    find_or_add_state(gen, set);
+
+    for (uint32_t state = 1; state < gen->num_states; ++state) {
+        for (uint32_t b = 0; b < 256; ++b) {
+            memset(set, 0, gen->nfa_words * sizeof(uint64_t));
+            const uint64_t *from = gen->sets + (uint64_t)state * gen->nfa_words;
+            for (Rule *rule = gen->rules; rule != array_end(gen->rules); ++rule) {
+                uint32_t n = (uint32_t)array_size(rule->items);
+                for (uint32_t k = 0; k <= n; ++k) {
+                    if (!set_has(from, rule->nfa_first + k))
+                        continue;
+                    if (k < n && set_has(rule->items[k].set, b))
+                        add_closure(rule, k + 1, set);
+                    // A repeated item can match again once it has matched
+                    if (k > 0 && (rule->items[k - 1].repeat == '*' || rule->items[k - 1].repeat == '+') &&
+                        set_has(rule->items[k - 1].set, b))
+                        add_closure(rule, k, set);
+                }
+            }
+            // `sets` may move while adding a state
+            uint32_t to = find_or_add_state(gen, set);
+            gen->next[state * 256 + b] = to;
+        }
+    }
+    free(set);
+}
+
+//
+// Minimization
+//
+
+static int32_t state_output(const Gen *gen, uint32_t state)
+{
+    if (state == 0)
+        return -2;
+    return gen->accept[state] >= 0 ? (int32_t)gen->rules[gen->accept[state]].output : -1;
+}
+
+static void minimize(Gen *gen)
+{
+    uint32_t n = gen->num_states;
+    uint32_t *part = calloc(n, sizeof(uint32_t));
+    uint32_t *new_part = calloc(n, sizeof(uint32_t));
+    uint32_t *sig = calloc((uint64_t)n * 257, sizeof(uint32_t));
+
+    // States start out grouped by what they emit, the dead state on its own
+    uint32_t num_parts = 0;
+    for (uint32_t s = 0; s < n; ++s) {
+        uint32_t p = 0;
+        while (p < s && state_output(gen, p) != state_output(gen, s))
+            ++p;
+        part[s] = p < s ? part[p] : num_parts++;
+    }
+
+    // Split groups until every state in a group moves to the same groups on every byte
+    for (;;) {
+        for (uint32_t s = 0; s < n; ++s) {
+            sig[s * 257] = part[s];
+            for (uint32_t b = 0; b < 256; ++b)
+                sig[s * 257 + 1 + b] = part[gen->next[s * 256 + b]];
+        }
+        uint32_t count = 0;
+        for (uint32_t s = 0; s < n; ++s) {
+            uint32_t p = 0;
+            while (p < s && memcmp(sig + p * 257, sig + s * 257, 257 * sizeof(uint32_t)) != 0)
+                ++p;
+            new_part[s] = p < s ? new_part[p] : count++;
+        }
+        memcpy(part, new_part, n * sizeof(uint32_t));
+        if (count == num_parts)
+            break;
+        num_parts = count;
+    }
+
+    // Number the groups in breadth first order from the start state, after the dead state
+    uint32_t *order = malloc(num_parts * sizeof(uint32_t));
+    uint32_t *rep = malloc(num_parts * sizeof(uint32_t));
+    for (uint32_t p = 0; p < num_parts; ++p)
+        order[p] = UINT32_MAX;
+    for (uint32_t s = n; s-- > 0;)
+        rep[part[s]] = s;
+    uint32_t num_min = 0;
+    order[part[0]] = num_min++;
+    order[part[1]] = num_min++;
+    uint32_t *queue = malloc(num_parts * sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+    queue[tail++] = part[1];
+    while (head < tail) {
+        uint32_t s = rep[queue[head++]];
+        for (uint32_t b = 0; b < 256; ++b) {
+            uint32_t p = part[gen->next[s * 256 + b]];
+            if (order[p] == UINT32_MAX) {
+                order[p] = num_min++;
+                queue[tail++] = p;
+            }
+        }
+    }
+
+    gen->num_min = num_min;
+    gen->min_next = calloc((uint64_t)num_min * 256, sizeof(uint32_t));
+    gen->min_accept = calloc(num_min, sizeof(int32_t));
+    for (uint32_t p = 0; p < num_parts; ++p) {
+        if (order[p] == UINT32_MAX)
+            continue;
+        uint32_t s = rep[p];
+        gen->min_accept[order[p]] = gen->accept[s];
+        for (uint32_t b = 0; b < 256; ++b)
+            gen->min_next[order[p] * 256 + b] = order[part[gen->next[s * 256 + b]]];
+    }
+
+    free(queue);
+    free(rep);
+    free(order);
+    free(sig);
+    free(new_part);
+    free(part);
+}
+
+static void build_classes(Gen *gen)
+{
+    uint32_t n = gen->num_min;
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t c = 0;
+        for (; c < b; ++c) {
+            uint32_t s = 0;
+            while (s < n && gen->min_next[s * 256 + c] == gen->min_next[s * 256 + b])
+                ++s;
+            if (s == n)
+                break;
+        }
+        gen->byte_class[b] = c < b ? gen->byte_class[c] : (uint8_t)gen->num_classes++;
+    }
+    while ((1u << gen->class_bits) < gen->num_classes)
+        ++gen->class_bits;
+}
+
+// Longest run of non-accepting live states starting at `s`, the bytes a match can read past its end
+static uint32_t pending_length(const Gen *gen, uint32_t s, uint32_t *memo, uint32_t depth)
+{
+    if (memo[s] != UINT32_MAX)
+        return memo[s];
+    if (depth > gen->num_min)
+        fail("a rule can read without bound before it matches, the lexer needs a bounded lookahead");
+    uint32_t longest = 0;
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t t = gen->min_next[s * 256 + b];
+        if (t != 0 && gen->min_accept[t] < 0) {
+            uint32_t len = 1 + pending_length(gen, t, memo, depth + 1);
+            longest = len > longest ? len : longest;
+        }
+    }
+    return memo[s] = longest;
+}
+
+static void build_lookahead(Gen *gen)
+{
+    uint32_t *memo = malloc(gen->num_min * sizeof(uint32_t));
+    memset(memo, 0xff, gen->num_min * sizeof(uint32_t));
+    uint32_t longest = 0;
+    for (uint32_t s = 1; s < gen->num_min; ++s) {
+        if (gen->min_accept[s] < 0)
+            continue;
+        uint32_t len = pending_length(gen, s, memo, 0);
+        longest = len > longest ? len : longest;
+    }
+    // The byte that ends the match is read too
+    gen->lookahead = longest + 1;
+    free(memo);
+
+    for (uint32_t b = 0; b < 256; ++b) {
+        if (gen->min_next[1 * 256 + b] == 0)
+            printf("dfa_gen: warning: byte 0x%02x can't start a token and is skipped\n", b);
+    }
+}
+
+//
+// Output
+//
+
+typedef struct Out {
+    char *text;
+} Out;
+
+static void out(Out *o, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(0, 0, fmt, args);
+    va_end(args);
+
+    uint64_t size = array_size(o->text);
+    array_ensure(o->text, size + len + 1, system_allocator);
+    va_start(args, fmt);
+    vsnprintf(o->text + size, len + 1, fmt, args);
+    va_end(args);
+    array_header(o->text)->size += len;
+}
+
+static void out_c_string(Out *o, const char *s)
+{
+    out(o, "\"");
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            out(o, "\\%c", *s);
+        else if ((uint8_t)*s < 0x20 || (uint8_t)*s >= 0x7f)
+            out(o, "\\x%02x", (uint8_t)*s);
+        else
+            out(o, "%c", *s);
+    }
+    out(o, "\"");
+}
+
+static void write_if_changed(const char *path, const Out *o)
+{
+    uint64_t size = array_size(o->text);
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        char *old = malloc(size + 1);
+        uint64_t read = fread(old, 1, size + 1, f);
+        fclose(f);
+        bool same = read == size && memcmp(old, o->text, size) == 0;
+        free(old);
+        if (same)
+            return;
+    }
+    f = fopen(path, "wb");
+    if (!f || fwrite(o->text, 1, size, f) != size)
+        fail("unable to write '%s'", path);
+    fclose(f);
+    printf("dfa_gen: wrote %s\n", path);
+}
+
+static void write_tokens(const Gen *gen, const char *path)
+{
+    Out o = { 0 };
+    out(&o, "#pragma once\n\n");
+    out(&o, "//\n// Generated by tools/dfa_gen.c from src/tokens.spec, do not edit\n//\n\n");
+
+    const char *lists[2] = { "LEXER_OPERATORS", "LEXER_KEYWORDS" };
+    for (uint32_t kind = RULE_OPERATOR; kind <= RULE_KEYWORD; ++kind) {
+        out(&o, "#define %s(X) \\\n", lists[kind]);
+        for (const Rule *rule = gen->rules; rule != array_end(gen->rules); ++rule) {
+            if (rule->kind != kind)
+                continue;
+            out(&o, "    X(%s, ", rule->name);
+            out_c_string(&o, rule->text);
+            out(&o, ") \\\n");
+        }
+        out(&o, "\n");
+    }
+
+    write_if_changed(path, &o);
+    array_free(o.text, system_allocator);
+}
+
+static void write_dfa(const Gen *gen, const char *path)
+{
+    Out o = { 0 };
+    out(&o, "#pragma once\n\n");
+    out(&o, "//\n// Generated by tools/dfa_gen.c from src/tokens.spec, do not edit\n");
+    out(&o, "// %u rules, %u NFA states, %u DFA states minimized to %u, %u byte classes\n//\n\n",
+        (uint32_t)array_size(gen->rules), gen->num_nfa, gen->num_states - 1, gen->num_min, gen->num_classes);
+
+    out(&o, "typedef enum Lexer_Action {\n");
+    out(&o, "    // Not a match\n    LEXER_ACTION_NONE,\n");
+    out(&o, "    // Emit the fixed token in `lexer_dfa_token`\n    LEXER_ACTION_TOKEN,\n");
+    for (uint32_t i = 0; i < array_size(gen->actions); ++i)
+        out(&o, "    LEXER_ACTION_%s,\n", gen->actions[i]);
+    out(&o, "} Lexer_Action;\n\n");
+
+    out(&o, "#define LEXER_DFA_DEAD 0\n");
+    out(&o, "#define LEXER_DFA_START 1\n");
+    out(&o, "#define LEXER_DFA_NUM_STATES %u\n", gen->num_min);
+    out(&o, "#define LEXER_DFA_NUM_CLASSES %u\n", gen->num_classes);
+    out(&o, "#define LEXER_DFA_CLASS_BITS %u\n", gen->class_bits);
+    out(&o, "// Bytes past the end of a token the DFA may read before it gives up on a longer match\n");
+    out(&o, "#define LEXER_DFA_LOOKAHEAD %u\n\n", gen->lookahead);
+
+    out(&o, "typedef %s Lexer_Dfa_State;\n\n", gen->num_min <= 256 ? "uint8_t" : "uint16_t");
+
+    out(&o, "static const uint8_t lexer_dfa_class[256] = {\n");
+    for (uint32_t b = 0; b < 256; b += 16) {
+        out(&o, "   ");
+        for (uint32_t i = 0; i < 16; ++i)
+            out(&o, " %2u,", gen->byte_class[b + i]);
+        out(&o, " // %02x\n", b);
+    }
+    out(&o, "};\n\n");
+
+    // Rows are padded to a power of two so a state's row is found with a shift
+    uint32_t row = 1u << gen->class_bits;
+    out(&o, "// Next state, indexed by (state << LEXER_DFA_CLASS_BITS) | class\n");
+    out(&o, "static const Lexer_Dfa_State lexer_dfa_next[LEXER_DFA_NUM_STATES << LEXER_DFA_CLASS_BITS] = {\n");
+    for (uint32_t s = 0; s < gen->num_min; ++s) {
+        out(&o, "   ");
+        for (uint32_t c = 0; c < row; ++c) {
+            uint32_t next = 0;
+            for (uint32_t b = 0; b < 256 && c < gen->num_classes; ++b) {
+                if (gen->byte_class[b] == c) {
+                    next = gen->min_next[s * 256 + b];
+                    break;
+                }
+            }
+            out(&o, " %u,", next);
+        }
+        out(&o, " // %u\n", s);
+    }
+    out(&o, "};\n\n");
+
+    out(&o, "static const uint8_t lexer_dfa_action[LEXER_DFA_NUM_STATES] = {\n");
+    for (uint32_t s = 0; s < gen->num_min; ++s) {
+        int32_t r = gen->min_accept[s];
+        const char *action = "LEXER_ACTION_NONE";
+        if (r >= 0)
+            action = gen->rules[r].kind == RULE_PATTERN ? gen->outputs[gen->rules[r].output] : "LEXER_ACTION_TOKEN";
+        out(&o, "    %s, // %u\n", action, s);
+    }
+    out(&o, "};\n\n");
+
+    out(&o, "static const uint16_t lexer_dfa_token[LEXER_DFA_NUM_STATES] = {\n");
+    for (uint32_t s = 0; s < gen->num_min; ++s) {
+        int32_t r = gen->min_accept[s];
+        bool fixed = r >= 0 && gen->rules[r].kind != RULE_PATTERN;
+        out(&o, "    %s, // %u\n", fixed ? gen->outputs[gen->rules[r].output] : "0", s);
+    }
+    out(&o, "};\n");
+
+    write_if_changed(path, &o);
+    array_free(o.text, system_allocator);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4) {
+        printf("Usage: dfa_gen <tokens.spec> <lexer_tokens.h> <lexer_dfa.h>\n");
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f)
+        fail("unable to read '%s'", argv[1]);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *spec = malloc(size + 1);
+    spec[fread(spec, 1, size, f)] = 0;
+    fclose(f);
+
+    Gen gen = { 0 };
+    parse_spec(&gen, spec);
+    build_dfa(&gen);
+    minimize(&gen);
+    build_classes(&gen);
+    build_lookahead(&gen);
+
+    write_tokens(&gen, argv[2]);
+    write_dfa(&gen, argv[3]);
+    printf("dfa_gen: %u rules, %u DFA states, %u byte classes, lookahead %u\n",
+        (uint32_t)array_size(gen.rules), gen.num_min, gen.num_classes, gen.lookahead);
+
+    free(spec);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+# Writes src/unicode_xid.h, the XID_Start and XID_Continue classes of every non-ASCII code point as
+# sorted ranges. Python's own identifier rules are XID_Start XID_Continue*, so the classes are taken
+# from str.isidentifier of the Unicode version this Python ships with.
+#
+#   python3 tools/xid_gen.py src/unicode_xid.h
+#
+
+import sys
+import unicodedata
+
+
+def ranges(pred):
+    out = []
+    for cp in range(0x80, 0x110000):
+        if 0xD800 <= cp <= 0xDFFF or not pred(chr(cp)):
+            continue
+        if out and out[-1][1] == cp - 1:
+            out[-1][1] = cp
+        else:
+            out.append([cp, cp])
+    return out
+
+
+def table(name, rs):
+    lines = ["static const Unicode_Range %s[%d] = {" % (name, len(rs))]
+    for i in range(0, len(rs), 4):
+        lines.append("    " + " ".join("{ 0x%05x, 0x%05x }," % (lo, hi) for lo, hi in rs[i:i + 4]))
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    start = ranges(lambda c: c.isidentifier())
+    cont = ranges(lambda c: ("a" + c).isidentifier())
+    out = "\n".join([
+        "#pragma once",
+        "#include \"foundation/basic.h\"",
+        "",
+        "// Generated by tools/xid_gen.py from Unicode %s, don't edit" % unicodedata.unidata_version,
+        "// Non-ASCII code points with the XID_Start and XID_Continue properties, as sorted inclusive ranges",
+        "",
+        "typedef struct Unicode_Range {",
+        "    uint32_t lo;",
+        "    uint32_t hi;",
+        "} Unicode_Range;",
+        "",
+        table("unicode_xid_start", start),
+        "",
+        table("unicode_xid_continue", cont),
+        "",
+    ])
+    with open(sys.argv[1] if len(sys.argv) > 1 else "src/unicode_xid.h", "w", newline="\n") as f:
+        f.write(out)
+
+
+if __name__ == "__main__":
+    main()